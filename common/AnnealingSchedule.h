@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+// Time and iteration budget of a search loop. The clock is read only once per
+// batch of iterations, so Tick() is cheap enough to be called on every move.
+class SearchBudget {
+   public:
+    explicit SearchBudget(
+        double maxTimeInSeconds,
+        size_t maxIterations = std::numeric_limits<size_t>::max(),
+        size_t batchSize = 1024)
+        : _maxTimeInMilliseconds(maxTimeInSeconds * 1000),
+          _maxIterations(maxIterations),
+          _batchSize(std::max<size_t>(1, batchSize)),
+          _start(std::chrono::steady_clock::now()) {}
+
+    // Counts one iteration. Returns false once the budget is exhausted.
+    bool Tick() {
+        if (++_iterations % _batchSize == 0 || _iterations >= _maxIterations) {
+            Refresh();
+        }
+        return !_expired;
+    }
+
+    // Fraction of the budget used so far, updated once per batch
+    double GetProgress() const { return _progress; }
+
+    size_t GetIterations() const { return _iterations; }
+
+    // Elapsed time, updated once per batch
+    size_t GetElapsedMilliseconds() const { return _elapsedInMilliseconds; }
+
+    bool IsExpired() const { return _expired; }
+
+    void Refresh() {
+        auto now = std::chrono::steady_clock::now();
+        _elapsedInMilliseconds =
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - _start)
+                .count();
+        double timeProgress = _elapsedInMilliseconds / _maxTimeInMilliseconds;
+        double iterationsProgress = (double)_iterations / _maxIterations;
+        _progress = std::min(1.0, std::max(timeProgress, iterationsProgress));
+        _expired = (_progress >= 1.0);
+    }
+
+   private:
+    double _maxTimeInMilliseconds;
+    size_t _maxIterations;
+    size_t _batchSize;
+    std::chrono::steady_clock::time_point _start;
+    size_t _iterations = 0;
+    size_t _elapsedInMilliseconds = 0;
+    double _progress = 0;
+    bool _expired = false;
+};
+
+// Temperature schedule of simulated annealing. The temperature is driven by
+// the search progress in [0, 1] (see SearchBudget::GetProgress) and, for the
+// adaptive schedule, by the observed acceptance rate.
+class AnnealingSchedule {
+   public:
+    enum class Kind {
+        // initTemp * (finalTemp / initTemp) ^ progress
+        Geometric,
+        // initTemp + (finalTemp - initTemp) * progress
+        Linear,
+        // initTemp * alpha / acceptedMoves
+        Hyperbolic,
+        // Temperature is tuned so that the acceptance rate of worsening moves
+        // follows targetAcceptance, which decreases linearly with progress.
+        // It never exceeds the geometric schedule: the rate of random moves
+        // may be out of reach at any temperature below the initial one.
+        Adaptive
+    };
+
+    struct Params {
+        Kind kind = Kind::Geometric;
+        double initTemp = 1;
+        double finalTemp = 1e-3;
+        double alpha = 0.994;
+        double targetAcceptance = 0.05;
+        // Number of worsening moves between adaptive temperature updates
+        size_t adaptationWindow = 1000;
+        // Number of evaluated moves without a new best solution after which
+        // the temperature is raised again. Zero disables reheats.
+        size_t reheatAfter = 0;
+        // Reheat temperature as a fraction of initTemp
+        double reheatFactor = 0.5;
+    };
+
+    // Part of the schedule which changes during the search
+    struct State {
+        double temp = 0;
+        double startTemp = 0;
+        double startProgress = 0;
+        double progress = 0;
+        size_t accepted = 0;
+        size_t sinceImprovement = 0;
+    };
+
+    AnnealingSchedule() : AnnealingSchedule(Params()) {}
+
+    explicit AnnealingSchedule(const Params& params) : _params(params) {
+        _state.temp = _state.startTemp = params.initTemp;
+    }
+
+    static Kind ParseKind(const std::string& name) {
+        if (name == "geometric") {
+            return Kind::Geometric;
+        } else if (name == "linear") {
+            return Kind::Linear;
+        } else if (name == "hyperbolic") {
+            return Kind::Hyperbolic;
+        } else if (name == "adaptive") {
+            return Kind::Adaptive;
+        }
+        throw std::invalid_argument("Unknown annealing schedule: " + name);
+    }
+
+    const Params& GetParams() const { return _params; }
+    const State& GetState() const { return _state; }
+    void SetState(const State& state) { _state = state; }
+
+    // Continues a schedule saved by GetState() in a search with a new
+    // budget: the temperature goes down from the saved one, not initTemp
+    void Resume(const State& state) {
+        _state = state;
+        _state.startTemp = state.temp;
+        _state.startProgress = 0;
+        _state.progress = 0;
+    }
+
+    double GetTemperature() const { return _state.temp; }
+
+    // Metropolis rule for a move which makes the objective worse by
+    // `worsening` (negative for improving moves)
+    template <class RandomEngine>
+    bool Accept(double worsening, RandomEngine& re) {
+        _state.sinceImprovement++;
+        bool accepted =
+            (worsening <= 0 || _unif(re) < std::exp(-worsening / _state.temp));
+        if (worsening > 0 && _params.kind == Kind::Adaptive) {
+            _worseningAccepted += accepted;
+            if (++_worseningTried == _params.adaptationWindow) {
+                Adapt();
+            }
+        }
+        if (accepted) {
+            _state.accepted++;
+            if (_params.kind == Kind::Hyperbolic) {
+                _state.temp =
+                    _state.startTemp * _params.alpha / _state.accepted;
+            }
+        }
+        return accepted;
+    }
+
+    // Should be called when the search finds a new best solution
+    void NotifyImprovement() { _state.sinceImprovement = 0; }
+
+    // Moves the schedule to the given progress. Cheap when progress has not
+    // changed, so it can be called on every iteration.
+    void Update(double progress) {
+        if (_params.reheatAfter &&
+            _state.sinceImprovement >= _params.reheatAfter) {
+            Reheat(progress);
+        }
+        if (progress == _state.progress) {
+            return;
+        }
+        _state.progress = progress;
+        double local = (_state.startProgress < 1
+                            ? (progress - _state.startProgress) /
+                                  (1 - _state.startProgress)
+                            : 1.0);
+        local = std::min(1.0, std::max(0.0, local));
+        switch (_params.kind) {
+            case Kind::Geometric:
+                _state.temp = GetGeometricTemperature(local);
+                break;
+            case Kind::Linear:
+                _state.temp = _state.startTemp +
+                              (_params.finalTemp - _state.startTemp) * local;
+                break;
+            case Kind::Adaptive:
+                _maxAdaptiveTemp = GetGeometricTemperature(local);
+                _state.temp = std::min(_state.temp, _maxAdaptiveTemp);
+                break;
+            case Kind::Hyperbolic:
+                break;
+        }
+        _state.temp = std::max(_state.temp, _params.finalTemp * 1e-3);
+    }
+
+   private:
+    Params _params;
+    State _state;
+    size_t _worseningTried = 0;
+    size_t _worseningAccepted = 0;
+    double _maxAdaptiveTemp = std::numeric_limits<double>::infinity();
+    std::uniform_real_distribution<double> _unif{0.0, 1.0};
+
+    double GetGeometricTemperature(double local) const {
+        return _state.startTemp *
+               std::pow(_params.finalTemp / _state.startTemp, local);
+    }
+
+    void Adapt() {
+        double rate = (double)_worseningAccepted / _worseningTried;
+        double target =
+            _params.targetAcceptance * (1 - _state.progress) + 1e-4;
+        _state.temp *= std::exp(std::max(-1.0, std::min(1.0, (target - rate) /
+                                                                 target)));
+        _state.temp = std::min(_state.temp, _maxAdaptiveTemp);
+        _worseningTried = _worseningAccepted = 0;
+    }
+
+    void Reheat(double progress) {
+        _state.sinceImprovement = 0;
+        _state.startTemp =
+            std::max(_state.temp, _params.initTemp * _params.reheatFactor);
+        _state.startProgress = progress;
+        _state.temp = _state.startTemp;
+        _state.accepted = 0;
+    }
+};
@@ -1,117 +1,1221 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
-#include <map>
+#include <memory>
 #include <numeric>
-#include <queue>
+#include <optional>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
-class Puzzle15Solver {
+// Open addressing hash table with linear probing from packed states to
+// their distances. State 0 is not a permutation, so it marks empty slots.
+template <class State>
+class StateTable {
  public:
-  const static int TABLE_WIDTH = 4;
-  const static int TABLE_HEIGHT = 4;
-  const static int N = TABLE_HEIGHT * TABLE_WIDTH;
-  using Table = std::array<std::array<int, TABLE_WIDTH>, TABLE_HEIGHT>;
+  constexpr static uint8_t NONE = UINT8_MAX;
+
+  explicit StateTable(size_t capacity = 1 << 16) { Reset(capacity); }
+
+  // Returns NONE if the state is not stored
+  uint8_t Get(State state) const {
+    for (size_t slot = Hash(state);; slot = (slot + 1) & _mask) {
+      if (_keys[slot] == state) {
+        return _values[slot];
+      }
+      if (_keys[slot] == 0) {
+        return NONE;
+      }
+    }
+  }
+
+  void Set(State state, uint8_t value) {
+    if (2 * (_size + 1) > _keys.size()) {
+      Grow();
+    }
+    size_t slot = Hash(state);
+    while (_keys[slot] != 0 && _keys[slot] != state) {
+      slot = (slot + 1) & _mask;
+    }
+    if (_keys[slot] == 0) {
+      _keys[slot] = state;
+      ++_size;
+    }
+    _values[slot] = value;
+  }
+
+  size_t Size() const { return _size; }
+
+  // Removes all states, keeps the memory
+  void Clear() {
+    std::fill(_keys.begin(), _keys.end(), 0);
+    _size = 0;
+  }
 
-  Table end{};
+ private:
+  std::vector<State> _keys;
+  std::vector<uint8_t> _values;
+  size_t _mask = 0;
+  size_t _size = 0;
+
+  void Reset(size_t capacity) {
+    _keys.assign(capacity, 0);
+    _values.assign(capacity, NONE);
+    _mask = capacity - 1;
+    _size = 0;
+  }
 
-  Puzzle15Solver() {
-    for (uint8_t i = 0; i + 1 < N; ++i) {
-      end[i / TABLE_WIDTH][i % TABLE_WIDTH] = i + 1;
+  size_t Hash(State state) const {
+    uint64_t folded = uint64_t(state);
+    if constexpr (sizeof(State) > sizeof(uint64_t)) {
+      folded ^= uint64_t(state >> 64);
     }
+    return ((folded * 0x9E3779B97F4A7C15ull) >> 20) & _mask;
   }
 
-  int64_t GetNumberOfSteps(const Table &start) const {
-    std::priority_queue<std::pair<int64_t, Table>> queue;
-    queue.push({-ComputePotential(start), start});
-    std::map<Table, int64_t> distance;
-    distance[start] = 0;
-    while (!queue.empty()) {
-      auto table = queue.top().second;
-      queue.pop();
-      if (table == end) {
-        break;
+  void Grow() {
+    auto keys = std::move(_keys);
+    auto values = std::move(_values);
+    Reset(2 * keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (keys[i] != 0) {
+        Set(keys[i], values[i]);
       }
-      int64_t newDistance = distance[table] + 1;
-      for (auto to : GetNeighbors(table)) {
-        if (distance.count(to) == 0 || distance[to] > newDistance) {
-          distance[to] = newDistance;
-          int64_t priority = newDistance + ComputePotential(to);
-          queue.push({-priority, to});
-        }
+    }
+  }
+};
+
+// Open list of A* for small integer priorities: a stack of states for every
+// pair of f and g. Pops return the smallest f, ties broken towards the
+// largest g (the deepest states are closest to the goal). Clear keeps the
+// memory, so the queue can be reused.
+template <class State>
+class BucketQueue {
+ public:
+
+  void Push(int f, int g, State state) {
+    if (f >= int(_buckets.size())) {
+      _buckets.resize(f + 1);
+      _topG.resize(f + 1, -1);
+    }
+    auto &bucket = _buckets[f];
+    if (g >= int(bucket.size())) {
+      bucket.resize(g + 1);
+    }
+    bucket[g].push_back(state);
+    _topG[f] = std::max(_topG[f], g);
+    _minF = std::min(_minF, f);
+    ++_size;
+  }
+
+  bool Empty() const { return _size == 0; }
+
+  size_t Size() const { return _size; }
+
+  // The smallest f of the states, INT32_MAX if there are none
+  int GetMinF() {
+    if (Empty()) {
+      return INT32_MAX;
+    }
+    while (_topG[_minF] < 0) {
+      ++_minF;
+    }
+    return _minF;
+  }
+
+  // Returns g and the state
+  std::pair<int, State> Pop() {
+    GetMinF();
+    auto &bucket = _buckets[_minF];
+    int g = _topG[_minF];
+    State state = bucket[g].back();
+    bucket[g].pop_back();
+    while (_topG[_minF] >= 0 && bucket[_topG[_minF]].empty()) {
+      --_topG[_minF];
+    }
+    --_size;
+    return {g, state};
+  }
+
+  void Clear() {
+    for (auto &bucket : _buckets) {
+      for (auto &states : bucket) {
+        states.clear();
       }
     }
-    return distance[end];
+    std::fill(_topG.begin(), _topG.end(), -1);
+    _minF = INT32_MAX;
+    _size = 0;
   }
 
  private:
-  static std::vector<Table> GetNeighbors(const Table &table) {
-    int h0 = 0;
-    int w0 = 0;
+  std::vector<std::vector<std::vector<State>>> _buckets;
+  // The largest g with states for every f, -1 if there are none
+  std::vector<int> _topG;
+  int _minF = INT32_MAX;
+  size_t _size = 0;
+};
+
+// Pattern database of the 15-puzzle: for every placement of the pattern
+// tiles, the number of moves of the pattern tiles needed to bring them to
+// their goal positions, with the other tiles indistinguishable. Moves of
+// disjoint patterns can be added up into an admissible potential.
+//
+// Placements are ranked as partial permutations of the positions. A value
+// is the pattern Manhattan distance plus twice the stored nibble, values
+// exceeding it by more than 30 are cut (which keeps them admissible).
+// File layout: uint32 magic, uint32 tileCount, uint8 tiles[16], then the
+// nibbles, two per byte, low nibble first.
+class PatternDatabase {
+ public:
+  using State = uint64_t;
+  const static int WIDTH = 4;
+  const static int HEIGHT = 4;
+  const static int N = WIDTH * HEIGHT;
+
+  PatternDatabase(const PatternDatabase &) = delete;
+  PatternDatabase &operator=(const PatternDatabase &) = delete;
+
+  ~PatternDatabase() {
+    if (_mapped) {
+      munmap(_mapped, _mappedSize);
+    }
+  }
+
+  // Maps the database from `filename`, nullptr if the file is missing or
+  // was built for another pattern
+  static std::unique_ptr<PatternDatabase> Load(const std::vector<int> &tiles,
+                                               const std::string &filename) {
+    std::unique_ptr<PatternDatabase> database(new PatternDatabase(tiles));
+    if (!database->Map(filename)) {
+      return nullptr;
+    }
+    return database;
+  }
+
+  // Maps the database from `filename`, or generates and saves it there if
+  // the file is missing or was built for another pattern
+  static std::unique_ptr<PatternDatabase> LoadOrGenerate(
+      const std::vector<int> &tiles, const std::string &filename) {
+    if (auto database = Load(tiles, filename)) {
+      return database;
+    }
+    std::unique_ptr<PatternDatabase> database(new PatternDatabase(tiles));
+    database->Generate();
+    try {
+      database->Save(filename);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << '\n';
+    }
+    return database;
+  }
+
+  const std::vector<int> &GetTiles() const { return _tiles; }
+
+  // Moves of the pattern tiles needed to solve the pattern
+  int Lookup(State state) const {
+    std::array<int, N> positions;
+    int manhattan = 0;
+    for (int pos = 0; pos < N; ++pos) {
+      int slot = _slotOf[(state >> (4 * pos)) & 15];
+      if (slot >= 0) {
+        positions[slot] = pos;
+        manhattan += _manhattan[slot][pos];
+      }
+    }
+    size_t rank = Rank(positions);
+    return manhattan + 2 * ((_data[rank / 2] >> (4 * (rank % 2))) & 15);
+  }
+
+ private:
+  const static uint32_t MAGIC = 0x31424450;  // "PDB1"
+  const static size_t HEADER_SIZE = 8 + N;
+  const static uint8_t UNVISITED = UINT8_MAX;
+
+  std::vector<int> _tiles;
+  // Index of a tile in the pattern, -1 for other tiles
+  std::array<int, N> _slotOf;
+  std::array<std::array<int, N>, N> _manhattan;
+  // Number of placements of the tiles after the given one
+  std::vector<size_t> _factors;
+  size_t _size = 1;
+  // Nibbles, either generated or mapped from the file
+  const uint8_t *_data = nullptr;
+  std::vector<uint8_t> _generated;
+  void *_mapped = nullptr;
+  size_t _mappedSize = 0;
+
+  explicit PatternDatabase(const std::vector<int> &tiles)
+      : _tiles(tiles), _factors(tiles.size()) {
+    _slotOf.fill(-1);
+    for (size_t slot = 0; slot < tiles.size(); ++slot) {
+      _slotOf[tiles[slot]] = slot;
+      int goal = tiles[slot] - 1;
+      for (int pos = 0; pos < N; ++pos) {
+        _manhattan[slot][pos] = std::abs(pos / WIDTH - goal / WIDTH) +
+                                std::abs(pos % WIDTH - goal % WIDTH);
+      }
+    }
+    for (size_t slot = tiles.size(); slot-- > 0;) {
+      _factors[slot] = _size;
+      _size *= N - slot;
+    }
+  }
+
+  size_t Rank(const std::array<int, N> &positions) const {
+    size_t rank = 0;
+    uint32_t used = 0;
+    for (size_t slot = 0; slot < _tiles.size(); ++slot) {
+      int pos = positions[slot];
+      int free = pos - __builtin_popcount(used & ((1u << pos) - 1));
+      rank += free * _factors[slot];
+      used |= 1u << pos;
+    }
+    return rank;
+  }
+
+  void Unrank(size_t rank, std::array<int, N> &positions) const {
+    uint32_t used = 0;
+    for (size_t slot = 0; slot < _tiles.size(); ++slot) {
+      int free = rank / _factors[slot];
+      rank %= _factors[slot];
+      int pos = 0;
+      for (;; ++pos) {
+        if (!(used & (1u << pos)) && free-- == 0) {
+          break;
+        }
+      }
+      positions[slot] = pos;
+      used |= 1u << pos;
+    }
+  }
+
+  // Cells reachable by the blank from `cell` through the cells which are
+  // not in `used`
+  static uint32_t FindRegion(int cell, uint32_t used) {
+    const uint32_t FREE = ~used & ((1u << N) - 1);
+    const uint32_t NOT_FIRST = 0xEEEE;  // cells not in the first column
+    const uint32_t NOT_LAST = 0x7777;   // cells not in the last column
+    uint32_t region = 1u << cell;
+    while (true) {
+      uint32_t grown = region | (region << WIDTH) | (region >> WIDTH) |
+                       ((region << 1) & NOT_FIRST) |
+                       ((region >> 1) & NOT_LAST);
+      grown &= FREE;
+      if (grown == region) {
+        return region;
+      }
+      region = grown;
+    }
+  }
+
+  // Breadth-first search from the goal over placements of the pattern tiles
+  // together with the region of the blank (blank moves among other tiles
+  // are free, so only the region matters; it is identified by its first
+  // cell). A pattern tile moves into an adjacent cell of the blank region at
+  // the cost of one move. Every level is expanded by all hardware threads,
+  // a state is claimed by the thread which marks it first. A placement
+  // keeps the minimum over the blank regions.
+  void Generate() {
+    std::vector<std::atomic<uint8_t>> depth(_size * N);
+    for (auto &d : depth) {
+      d.store(UNVISITED, std::memory_order_relaxed);
+    }
+    std::array<int, N> positions;
+    uint32_t used = 0;
+    for (size_t slot = 0; slot < _tiles.size(); ++slot) {
+      positions[slot] = _tiles[slot] - 1;
+      used |= 1u << positions[slot];
+    }
+    // The blank is in the last cell in the goal
+    uint64_t start = Rank(positions) * N +
+                     __builtin_ctz(FindRegion(N - 1, used));
+    depth[start] = 0;
+
+    const size_t threadsCount =
+        std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint64_t> frontier = {start};
+    for (uint8_t level = 0; !frontier.empty(); ++level) {
+      std::vector<std::vector<uint64_t>> next(threadsCount);
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < threadsCount; ++t) {
+        threads.emplace_back([&, t] {
+          std::array<int, N> positions;
+          for (size_t i = t; i < frontier.size(); i += threadsCount) {
+            Unrank(frontier[i] / N, positions);
+            uint32_t used = 0;
+            for (size_t slot = 0; slot < _tiles.size(); ++slot) {
+              used |= 1u << positions[slot];
+            }
+            uint32_t region = FindRegion(frontier[i] % N, used);
+            for (size_t slot = 0; slot < _tiles.size(); ++slot) {
+              int from = positions[slot];
+              for (int to : {from - WIDTH, from + WIDTH, from - 1, from + 1}) {
+                bool isNeighbor = (to >= 0 && to < N &&
+                                   (to / WIDTH == from / WIDTH ||
+                                    to % WIDTH == from % WIDTH));
+                if (!isNeighbor || !(region & (1u << to))) {
+                  continue;
+                }
+                positions[slot] = to;
+                uint32_t toUsed = used ^ (1u << from) ^ (1u << to);
+                uint64_t state = Rank(positions) * N +
+                                 __builtin_ctz(FindRegion(from, toUsed));
+                positions[slot] = from;
+                uint8_t expected = UNVISITED;
+                if (depth[state].load(std::memory_order_relaxed) ==
+                        UNVISITED &&
+                    depth[state].compare_exchange_strong(
+                        expected, level + 1, std::memory_order_relaxed)) {
+                  next[t].push_back(state);
+                }
+              }
+            }
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      frontier.clear();
+      for (const auto &states : next) {
+        frontier.insert(frontier.end(), states.begin(), states.end());
+      }
+    }
+
+    _generated.assign((_size + 1) / 2, 0);
+    for (size_t rank = 0; rank < _size; ++rank) {
+      int minDepth = UNVISITED;
+      for (int cell = 0; cell < N; ++cell) {
+        minDepth = std::min<int>(minDepth, depth[rank * N + cell]);
+      }
+      Unrank(rank, positions);
+      int manhattan = 0;
+      for (size_t slot = 0; slot < _tiles.size(); ++slot) {
+        manhattan += _manhattan[slot][positions[slot]];
+      }
+      int extra = std::min(15, (minDepth - manhattan) / 2);
+      _generated[rank / 2] |= extra << (4 * (rank % 2));
+    }
+    _data = _generated.data();
+  }
+
+  // Writes a temporary file and renames it, so a concurrent reader never
+  // maps a partial database
+  void Save(const std::string &filename) const {
+    const std::string tmpFilename = filename + ".tmp";
+    {
+      std::ofstream out(tmpFilename, std::ios::binary);
+      uint32_t header[2] = {MAGIC, uint32_t(_tiles.size())};
+      out.write(reinterpret_cast<const char *>(header), sizeof(header));
+      std::array<uint8_t, N> tiles{};
+      std::copy(_tiles.begin(), _tiles.end(), tiles.begin());
+      out.write(reinterpret_cast<const char *>(tiles.data()), N);
+      out.write(reinterpret_cast<const char *>(_generated.data()),
+                _generated.size());
+      if (!out) {
+        throw std::runtime_error("Failed to write " + tmpFilename);
+      }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+      throw std::runtime_error("Failed to replace " + filename);
+    }
+  }
+
+  // Returns false if the file is missing or does not match the pattern
+  bool Map(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat info;
+    size_t expectedSize = HEADER_SIZE + (_size + 1) / 2;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && size_t(info.st_size) == expectedSize) {
+      mapped = mmap(nullptr, expectedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      return false;
+    }
+    const auto *bytes = static_cast<const uint8_t *>(mapped);
+    uint32_t header[2];
+    std::memcpy(header, bytes, sizeof(header));
+    bool matches = (header[0] == MAGIC && header[1] == _tiles.size());
+    for (size_t slot = 0; matches && slot < _tiles.size(); ++slot) {
+      matches = (bytes[sizeof(header) + slot] == _tiles[slot]);
+    }
+    if (!matches) {
+      munmap(mapped, expectedSize);
+      return false;
+    }
+    _mapped = mapped;
+    _mappedSize = expectedSize;
+    _data = bytes + HEADER_SIZE;
+    return true;
+  }
+};
+
+// Number of bits needed to store values up to `value`
+constexpr int CountBits(int value) {
+  int bits = 0;
+  while ((1 << bits) <= value) {
+    ++bits;
+  }
+  return bits;
+}
+
+// Geometry of a WIDTH x HEIGHT sliding puzzle computed at compile time.
+// A state is packed into BITS bits per position: the tile at position p
+// occupies bits [BITS * p, BITS * (p + 1)), the blank is tile 0. Boards
+// which do not fit into 64 bits use 128-bit states.
+template <int WIDTH, int HEIGHT>
+struct Board {
+  constexpr static int N = WIDTH * HEIGHT;
+  constexpr static int BITS = CountBits(N - 1);
+  using State = std::conditional_t<N * BITS <= 64, uint64_t, unsigned __int128>;
+  constexpr static State TILE_MASK = (State(1) << BITS) - 1;
+
+  // Positions the blank can move to from every position
+  std::array<std::array<int, 4>, N> moves{};
+  std::array<int, N> movesCount{};
+  // Goal position of every tile, the blank is in the last cell
+  std::array<int, N> goalPosition{};
+  // Manhattan distance of a tile at a position to its goal position
+  std::array<std::array<int, N>, N> manhattan{};
+  State goal = 0;
+  // The lowest bit of every position
+  State lowBits = 0;
+
+  constexpr Board() {
+    for (int pos = 0; pos < N; ++pos) {
+      int h = pos / WIDTH;
+      int w = pos % WIDTH;
+      if (h > 0) {
+        moves[pos][movesCount[pos]++] = pos - WIDTH;
+      }
+      if (w > 0) {
+        moves[pos][movesCount[pos]++] = pos - 1;
+      }
+      if (w + 1 < WIDTH) {
+        moves[pos][movesCount[pos]++] = pos + 1;
+      }
+      if (h + 1 < HEIGHT) {
+        moves[pos][movesCount[pos]++] = pos + WIDTH;
+      }
+      lowBits |= State(1) << (BITS * pos);
+    }
+    for (int tile = 0; tile < N; ++tile) {
+      goalPosition[tile] = (tile + N - 1) % N;
+      if (tile) {
+        goal |= State(tile) << (BITS * goalPosition[tile]);
+      }
+      for (int pos = 0; pos < N; ++pos) {
+        int dh = pos / WIDTH - goalPosition[tile] / WIDTH;
+        int dw = pos % WIDTH - goalPosition[tile] % WIDTH;
+        manhattan[tile][pos] =
+            (tile ? (dh < 0 ? -dh : dh) + (dw < 0 ? -dw : dw) : 0);
+      }
+    }
+  }
+};
+
+// Optimal solver of the WIDTH x HEIGHT sliding puzzle.
+// The potential is the Manhattan distance plus linear conflicts: two tiles
+// in their goal line but in reversed order need two extra moves. Conflicts
+// of every possible row and column are precomputed when the lines fit into
+// 16 bits. On the 4x4 board pattern databases can be added, then the
+// potential is the largest of it, the sum over the patterns and the same sum
+// for the state reflected in the main diagonal.
+template <int WIDTH, int HEIGHT>
+class SlidingPuzzleSolver {
+ public:
+  const static int TABLE_WIDTH = WIDTH;
+  const static int TABLE_HEIGHT = HEIGHT;
+  const static int N = TABLE_HEIGHT * TABLE_WIDTH;
+  using Table = std::array<std::array<int, TABLE_WIDTH>, TABLE_HEIGHT>;
+  using State = typename Board<WIDTH, HEIGHT>::State;
+
+  enum class Search {
+    // Best-first search, keeps every generated state
+    AStar,
+    // Iterative deepening depth-first search in constant memory
+    IDAStar,
+    // A* from both ends, each side estimates the distance to the other
+    // end: the forward side by the full potential, the backward side by
+    // Manhattan distance
+    Bidirectional
+  };
+
+  SlidingPuzzleSolver() {
+    _databaseOf.fill(-1);
+    if constexpr (TABULATED_CONFLICTS) {
+      _rowConflicts.assign(HEIGHT, std::vector<uint8_t>(1 << (BITS * WIDTH)));
+      _columnConflicts.assign(WIDTH,
+                              std::vector<uint8_t>(1 << (BITS * HEIGHT)));
+      std::array<int, std::max(WIDTH, HEIGHT)> tiles;
+      for (int h = 0; h < HEIGHT; ++h) {
+        for (uint32_t key = 0; key < _rowConflicts[h].size(); ++key) {
+          for (int w = 0; w < WIDTH; ++w) {
+            tiles[w] = (key >> (BITS * w)) & TILE_MASK;
+          }
+          _rowConflicts[h][key] =
+              ComputeLineConflicts(tiles.data(), WIDTH, h, true);
+        }
+      }
+      for (int w = 0; w < WIDTH; ++w) {
+        for (uint32_t key = 0; key < _columnConflicts[w].size(); ++key) {
+          for (int h = 0; h < HEIGHT; ++h) {
+            tiles[h] = (key >> (BITS * h)) & TILE_MASK;
+          }
+          _columnConflicts[w][key] =
+              ComputeLineConflicts(tiles.data(), HEIGHT, w, false);
+        }
+      }
+    }
+  }
+
+  // The patterns of the databases must be disjoint
+  void SetPatternDatabases(
+      const std::vector<const PatternDatabase *> &databases) {
+    static_assert(HAS_PATTERNS, "Pattern databases are built for 4x4 boards");
+    _databases = databases;
+    _databaseOf.fill(-1);
+    for (size_t d = 0; d < databases.size(); ++d) {
+      for (int tile : databases[d]->GetTiles()) {
+        _databaseOf[tile] = d;
+      }
+    }
+  }
+
+  // A puzzle can be solved iff its permutation parity matches the one of
+  // the goal. A vertical move changes the parity of the inversions when
+  // the width is even, together with the row of the blank.
+  static bool IsSolvable(const Table &table) {
+    std::array<int, N> tiles;
+    int blankRow = 0;
     for (int i = 0; i < TABLE_HEIGHT; ++i) {
       for (int j = 0; j < TABLE_WIDTH; ++j) {
+        tiles[i * TABLE_WIDTH + j] = table[i][j];
         if (table[i][j] == 0) {
-          h0 = i;
-          w0 = j;
-          break;
+          blankRow = i;
+        }
+      }
+    }
+    int inversions = 0;
+    for (int i = 0; i < N; ++i) {
+      for (int j = i + 1; j < N; ++j) {
+        inversions += (tiles[i] && tiles[j] && tiles[i] > tiles[j]);
+      }
+    }
+    if (TABLE_WIDTH % 2) {
+      return inversions % 2 == 0;
+    }
+    return (inversions + blankRow) % 2 == (TABLE_HEIGHT - 1) % 2;
+  }
+
+  // Memory of A* which can be reused between puzzles, one per thread
+  struct Workspace {
+    StateTable<State> distance;
+    BucketQueue<State> queue;
+    // The backward side of the bidirectional search
+    StateTable<State> backwardDistance;
+    BucketQueue<State> backwardQueue;
+  };
+
+  int64_t GetNumberOfSteps(const Table &start,
+                           Search search = Search::IDAStar) const {
+    Workspace workspace;
+    return GetNumberOfSteps(start, search, workspace);
+  }
+
+  int64_t GetNumberOfSteps(const Table &start, Search search,
+                           Workspace &workspace) const {
+    State state = Validate(start);
+    switch (search) {
+      case Search::AStar:
+        return RunAStar(state, workspace);
+      case Search::Bidirectional:
+        return RunBidirectional(state, workspace);
+      default:
+        return *RunIDAStar(state, INT64_MAX);
+    }
+  }
+
+  // IDA* which gives up after visiting `maxNodes` nodes
+  std::optional<int64_t> TryGetNumberOfSteps(const Table &start,
+                                             int64_t maxNodes) const {
+    return RunIDAStar(Validate(start), maxNodes);
+  }
+
+ private:
+  constexpr static Board<WIDTH, HEIGHT> BOARD{};
+  constexpr static int BITS = Board<WIDTH, HEIGHT>::BITS;
+  constexpr static State TILE_MASK = Board<WIDTH, HEIGHT>::TILE_MASK;
+  constexpr static bool HAS_PATTERNS = (WIDTH == 4 && HEIGHT == 4);
+  constexpr static bool TABULATED_CONFLICTS =
+      (BITS * std::max(WIDTH, HEIGHT) <= 16);
+
+  // Reflection of a square board in its main diagonal: position (h, w) goes
+  // to (w, h) and a tile to the tile whose goal is its reflected goal. The
+  // goal stays in place and moves stay moves, so a reflected state is as far
+  // from the goal as the state itself
+  constexpr static std::array<int, N> REFLECTED_POSITION = [] {
+    std::array<int, N> reflected{};
+    for (int pos = 0; pos < N; ++pos) {
+      reflected[pos] =
+          (WIDTH == HEIGHT ? pos % WIDTH * WIDTH + pos / WIDTH : pos);
+    }
+    return reflected;
+  }();
+  constexpr static std::array<int, N> REFLECTED_TILE = [] {
+    std::array<int, N> reflected{};
+    for (int tile = 1; tile < N; ++tile) {
+      reflected[tile] = REFLECTED_POSITION[tile - 1] + 1;
+    }
+    return reflected;
+  }();
+
+  // Extra moves caused by linear conflicts in a line by its packed tiles
+  std::vector<std::vector<uint8_t>> _rowConflicts;
+  std::vector<std::vector<uint8_t>> _columnConflicts;
+  std::vector<const PatternDatabase *> _databases;
+  // Index of the database of a tile, -1 if the tile is in no pattern
+  std::array<int, N> _databaseOf;
+
+  const static int MAX_DATABASES = N;
+
+  // Parts of the potential which are updated incrementally by IDA*
+  struct Potential {
+    // Manhattan distance plus linear conflicts
+    int linear = 0;
+    int patterns = 0;
+    std::array<uint8_t, MAX_DATABASES> pattern{};
+    // The same databases looked up in the reflected state
+    int reflectedPatterns = 0;
+    std::array<uint8_t, MAX_DATABASES> reflectedPattern{};
+
+    int Get() const { return std::max({linear, patterns, reflectedPatterns}); }
+  };
+
+  int64_t RunAStar(State startState, Workspace &workspace) const {
+    auto &queue = workspace.queue;
+    auto &distance = workspace.distance;
+    queue.Clear();
+    distance.Clear();
+    queue.Push(ComputePotential(startState), 0, startState);
+    distance.Set(startState, 0);
+    while (!queue.Empty()) {
+      auto [stateDistance, state] = queue.Pop();
+      if (stateDistance != distance.Get(state)) {
+        // A duplicate left after the distance was decreased
+        continue;
+      }
+      if (state == BOARD.goal) {
+        return stateDistance;
+      }
+      int newDistance = stateDistance + 1;
+      int blank = FindBlank(state);
+      for (int m = 0; m < BOARD.movesCount[blank]; ++m) {
+        State to = Move(state, blank, BOARD.moves[blank][m]);
+        uint8_t toDistance = distance.Get(to);
+        if (toDistance == StateTable<State>::NONE || toDistance > newDistance) {
+          distance.Set(to, newDistance);
+          queue.Push(newDistance + ComputePotential(to), newDistance, to);
+        }
+      }
+    }
+    throw std::runtime_error("The puzzle is not solvable");
+  }
+
+  // Front-to-end bidirectional A*: the forward side estimates the distance
+  // to the goal by the full potential, the backward side the distance to the
+  // start by Manhattan distance. The side with the smaller open list is
+  // expanded. The best path through a state reached from both sides is
+  // optimal once no open state of either side can give a shorter one.
+  int64_t RunBidirectional(State startState, Workspace &workspace) const {
+    if (startState == BOARD.goal) {
+      return 0;
+    }
+    std::array<int, N> startPosition;
+    for (int pos = 0; pos < N; ++pos) {
+      startPosition[GetTile(startState, pos)] = pos;
+    }
+    auto estimateToStart = [&](State state) {
+      int potential = 0;
+      for (int pos = 0; pos < N; ++pos) {
+        int tile = GetTile(state, pos);
+        if (tile) {
+          potential +=
+              std::abs(pos / WIDTH - startPosition[tile] / WIDTH) +
+              std::abs(pos % WIDTH - startPosition[tile] % WIDTH);
+        }
+      }
+      return potential;
+    };
+
+    std::array<StateTable<State> *, 2> distances = {
+        &workspace.distance, &workspace.backwardDistance};
+    std::array<BucketQueue<State> *, 2> queues = {&workspace.queue,
+                                                  &workspace.backwardQueue};
+    for (int side = 0; side < 2; ++side) {
+      distances[side]->Clear();
+      queues[side]->Clear();
+    }
+    distances[0]->Set(startState, 0);
+    queues[0]->Push(ComputePotential(startState), 0, startState);
+    distances[1]->Set(BOARD.goal, 0);
+    queues[1]->Push(estimateToStart(BOARD.goal), 0, BOARD.goal);
+
+    int best = INT32_MAX;
+    while (!queues[0]->Empty() && !queues[1]->Empty()) {
+      if (std::max(queues[0]->GetMinF(), queues[1]->GetMinF()) >= best) {
+        return best;
+      }
+      int side = (queues[0]->Size() <= queues[1]->Size() ? 0 : 1);
+      auto &distance = *distances[side];
+      const auto &other = *distances[1 - side];
+      auto [stateDistance, state] = queues[side]->Pop();
+      if (stateDistance != distance.Get(state)) {
+        continue;
+      }
+      int newDistance = stateDistance + 1;
+      int blank = FindBlank(state);
+      for (int m = 0; m < BOARD.movesCount[blank]; ++m) {
+        State to = Move(state, blank, BOARD.moves[blank][m]);
+        uint8_t toDistance = distance.Get(to);
+        if (toDistance != StateTable<State>::NONE &&
+            toDistance <= newDistance) {
+          continue;
+        }
+        distance.Set(to, newDistance);
+        int potential =
+            (side == 0 ? ComputePotential(to) : estimateToStart(to));
+        queues[side]->Push(newDistance + potential, newDistance, to);
+        uint8_t otherDistance = other.Get(to);
+        if (otherDistance != StateTable<State>::NONE) {
+          best = std::min(best, newDistance + otherDistance);
+        }
+      }
+    }
+    if (best == INT32_MAX) {
+      throw std::runtime_error("The puzzle is not solvable");
+    }
+    return best;
+  }
+
+  // Depth-first searches bounded by f = g + h, the bound grows to the
+  // smallest f which exceeded it. The potential of a neighbour is updated
+  // from the moved tile: its Manhattan distance, the conflicts of the two
+  // lines it left and entered and the value of its pattern, as well as the
+  // value of the pattern of its image in the reflected state.
+  // Nothing if more than `maxNodes` nodes are visited
+  std::optional<int64_t> RunIDAStar(State start, int64_t maxNodes) const {
+    Potential potential = ComputePotentialParts(start);
+    int bound = potential.Get();
+    int64_t nodesLeft = maxNodes;
+    State reflected = 0;
+    if constexpr (HAS_PATTERNS) {
+      reflected = Reflect(start);
+    }
+    while (true) {
+      int next = SearchBounded(start, reflected, FindBlank(start), N, 0,
+                               potential, bound, nodesLeft);
+      if (next == FOUND) {
+        return bound;
+      }
+      if (next == OUT_OF_NODES) {
+        return std::nullopt;
+      }
+      if (next == NOT_FOUND) {
+        throw std::runtime_error("The puzzle is not solvable");
+      }
+      bound = next;
+    }
+  }
+
+  const static int FOUND = -1;
+  const static int OUT_OF_NODES = -2;
+  const static int NOT_FOUND = INT32_MAX;
+
+  // Returns FOUND, OUT_OF_NODES or the smallest f above the bound
+  int SearchBounded(State state, State reflected, int blank,
+                    int previousBlank, int distance,
+                    const Potential &potential, int bound,
+                    int64_t &nodesLeft) const {
+    if (--nodesLeft < 0) {
+      return OUT_OF_NODES;
+    }
+    int f = distance + potential.Get();
+    if (f > bound) {
+      return f;
+    }
+    if (state == BOARD.goal) {
+      return FOUND;
+    }
+    int next = NOT_FOUND;
+    for (int m = 0; m < BOARD.movesCount[blank]; ++m) {
+      int to = BOARD.moves[blank][m];
+      if (to == previousBlank) {
+        continue;
+      }
+      State toState = Move(state, blank, to);
+      int tile = GetTile(state, to);
+      Potential toPotential = potential;
+      toPotential.linear +=
+          BOARD.manhattan[tile][blank] - BOARD.manhattan[tile][to];
+      if (to / TABLE_WIDTH == blank / TABLE_WIDTH) {
+        // The tile changed its column
+        for (int w : {to % TABLE_WIDTH, blank % TABLE_WIDTH}) {
+          toPotential.linear +=
+              GetLineConflicts(toState, w, false) -
+              GetLineConflicts(state, w, false);
+        }
+      } else {
+        for (int h : {to / TABLE_WIDTH, blank / TABLE_WIDTH}) {
+          toPotential.linear += GetLineConflicts(toState, h, true) -
+                                GetLineConflicts(state, h, true);
         }
       }
+      State toReflected = reflected;
+      if constexpr (HAS_PATTERNS) {
+        if (!_databases.empty() && _databaseOf[tile] >= 0) {
+          int d = _databaseOf[tile];
+          int value = _databases[d]->Lookup(toState);
+          toPotential.patterns += value - potential.pattern[d];
+          toPotential.pattern[d] = value;
+        }
+        if (!_databases.empty()) {
+          // The reflected tile moves between the reflected positions
+          toReflected = Move(reflected, REFLECTED_POSITION[blank],
+                             REFLECTED_POSITION[to]);
+          int d = _databaseOf[REFLECTED_TILE[tile]];
+          if (d >= 0) {
+            int value = _databases[d]->Lookup(toReflected);
+            toPotential.reflectedPatterns +=
+                value - potential.reflectedPattern[d];
+            toPotential.reflectedPattern[d] = value;
+          }
+        }
+      }
+      int result = SearchBounded(toState, toReflected, to, blank,
+                                 distance + 1, toPotential, bound, nodesLeft);
+      if (result == FOUND || result == OUT_OF_NODES) {
+        return result;
+      }
+      next = std::min(next, result);
     }
+    return next;
+  }
 
-    Table next = table;
-    std::vector<Table> neighbors;
-    for (int dh = -1; dh < 2; ++dh) {
-      for (int dw = -1; dw < 2; ++dw) {
-        if (std::abs(dh) != std::abs(dw) && IsPositionValid(h0 + dh, w0 + dw)) {
-          std::swap(next[h0][w0], next[h0 + dh][w0 + dw]);
-          neighbors.push_back(next);
-          std::swap(next[h0][w0], next[h0 + dh][w0 + dw]);
+  // Packs the table, throws if it is not a solvable permutation
+  static State Validate(const Table &table) {
+    std::array<bool, N> seen{};
+    for (const auto &row : table) {
+      for (int tile : row) {
+        if (tile < 0 || tile >= N || seen[tile]) {
+          throw std::invalid_argument("The table is not a permutation");
         }
+        seen[tile] = true;
       }
     }
-    return neighbors;
+    if (!IsSolvable(table)) {
+      throw std::runtime_error("The puzzle is not solvable");
+    }
+    return Pack(table);
   }
 
-  static int64_t ComputePotential(const Table &table) {
-    int64_t potential = 0;
+  static State Pack(const Table &table) {
+    State state = 0;
     for (int i = 0; i < TABLE_HEIGHT; ++i) {
       for (int j = 0; j < TABLE_WIDTH; ++j) {
-        std::pair<int, int> truePos = GetPositionByItem(table[i][j]);
-        potential += std::abs(i - truePos.first) + std::abs(j - truePos.second);
+        state |= State(table[i][j]) << (BITS * (i * TABLE_WIDTH + j));
       }
     }
-    return potential;
+    return state;
+  }
+
+  static int GetTile(State state, int pos) {
+    return int((state >> (BITS * pos)) & TILE_MASK);
+  }
+
+  // Position of the only zero tile
+  static int FindBlank(State state) {
+    State nonZero = state;
+    for (int shift = 1; shift < BITS; ++shift) {
+      nonZero |= state >> shift;
+    }
+    State zero = ~nonZero & BOARD.lowBits;
+    if constexpr (sizeof(State) > sizeof(uint64_t)) {
+      uint64_t low = uint64_t(zero);
+      return (low ? __builtin_ctzll(low)
+                  : 64 + __builtin_ctzll(uint64_t(zero >> 64))) /
+             BITS;
+    } else {
+      return __builtin_ctzll(zero) / BITS;
+    }
+  }
+
+  // Moves the tile at position `to` into the blank at position `blank`
+  static State Move(State state, int blank, int to) {
+    State tile = GetTile(state, to);
+    return state - (tile << (BITS * to)) + (tile << (BITS * blank));
+  }
+
+  static State Reflect(State state) {
+    State reflected = 0;
+    for (int pos = 0; pos < N; ++pos) {
+      reflected |= State(REFLECTED_TILE[GetTile(state, pos)])
+                   << (BITS * REFLECTED_POSITION[pos]);
+    }
+    return reflected;
   }
 
-  static bool IsPositionValid(int h, int w) {
-    return (std::min(h, w) >= 0 && h < TABLE_HEIGHT && w < TABLE_WIDTH);
+  static uint32_t GetRow(State state, int h) {
+    return uint32_t(state >> (BITS * TABLE_WIDTH * h)) &
+           ((1u << (BITS * TABLE_WIDTH)) - 1);
   }
 
-  static std::pair<int, int> GetPositionByItem(int item) {
-    item = (item + N - 1) % N;
-    return {item / TABLE_WIDTH, item % TABLE_WIDTH};
+  static uint32_t GetColumn(State state, int w) {
+    uint32_t column = 0;
+    for (int h = 0; h < TABLE_HEIGHT; ++h) {
+      column |= GetTile(state, h * TABLE_WIDTH + w) << (BITS * h);
+    }
+    return column;
+  }
+
+  int GetLineConflicts(State state, int line, bool isRow) const {
+    if constexpr (TABULATED_CONFLICTS) {
+      return (isRow ? _rowConflicts[line][GetRow(state, line)]
+                    : _columnConflicts[line][GetColumn(state, line)]);
+    } else {
+      std::array<int, std::max(WIDTH, HEIGHT)> tiles;
+      int count = (isRow ? TABLE_WIDTH : TABLE_HEIGHT);
+      for (int i = 0; i < count; ++i) {
+        tiles[i] = GetTile(state, isRow ? line * TABLE_WIDTH + i
+                                        : i * TABLE_WIDTH + line);
+      }
+      return ComputeLineConflicts(tiles.data(), count, line, isRow);
+    }
+  }
+
+  // Two extra moves for every tile which has to leave the line so that the
+  // other tiles of their goal line get into the goal order
+  static int ComputeLineConflicts(const int *tiles, int count, int line,
+                                  bool isRow) {
+    std::array<int, std::max(WIDTH, HEIGHT)> goals;
+    int goalsCount = 0;
+    for (int i = 0; i < count; ++i) {
+      int tile = tiles[i];
+      if (tile == 0 || tile >= N) {
+        continue;
+      }
+      int goal = BOARD.goalPosition[tile];
+      if ((isRow ? goal / TABLE_WIDTH : goal % TABLE_WIDTH) == line) {
+        goals[goalsCount++] = (isRow ? goal % TABLE_WIDTH : goal / TABLE_WIDTH);
+      }
+    }
+    // Longest increasing subsequence of the goal positions stays in place
+    std::array<int, std::max(WIDTH, HEIGHT)> longest;
+    int longestOverall = 0;
+    for (int i = 0; i < goalsCount; ++i) {
+      longest[i] = 1;
+      for (int j = 0; j < i; ++j) {
+        if (goals[j] < goals[i]) {
+          longest[i] = std::max(longest[i], longest[j] + 1);
+        }
+      }
+      longestOverall = std::max(longestOverall, longest[i]);
+    }
+    return 2 * (goalsCount - longestOverall);
+  }
+
+  // Sum of Manhattan distances of the tiles except the blank plus linear
+  // conflicts, and values of the patterns
+  Potential ComputePotentialParts(State state) const {
+    Potential potential;
+    for (int pos = 0; pos < N; ++pos) {
+      potential.linear += BOARD.manhattan[GetTile(state, pos)][pos];
+    }
+    for (int h = 0; h < TABLE_HEIGHT; ++h) {
+      potential.linear += GetLineConflicts(state, h, true);
+    }
+    for (int w = 0; w < TABLE_WIDTH; ++w) {
+      potential.linear += GetLineConflicts(state, w, false);
+    }
+    if constexpr (HAS_PATTERNS) {
+      State reflected = Reflect(state);
+      for (size_t d = 0; d < _databases.size(); ++d) {
+        potential.pattern[d] = _databases[d]->Lookup(state);
+        potential.patterns += potential.pattern[d];
+        potential.reflectedPattern[d] = _databases[d]->Lookup(reflected);
+        potential.reflectedPatterns += potential.reflectedPattern[d];
+      }
+    }
+    return potential;
+  }
+
+  int ComputePotential(State state) const {
+    return ComputePotentialParts(state).Get();
   }
 };
 
-void solve(std::istream &in, std::ostream &out) {
+using Puzzle8Solver = SlidingPuzzleSolver<3, 3>;
+using Puzzle15Solver = SlidingPuzzleSolver<4, 4>;
+using Puzzle24Solver = SlidingPuzzleSolver<5, 5>;
+
+// Additive 6-6-3 partition of the tiles
+const std::vector<std::vector<int>> PATTERNS = {
+    {1, 5, 6, 9, 10, 13}, {7, 8, 11, 12, 14, 15}, {2, 3, 4}};
+
+// Generating the databases takes about half a minute, so IDA* first tries
+// every puzzle without them and gives up after this many nodes (about four
+// seconds)
+const int64_t MAX_NODES_WITHOUT_PATTERNS = 100'000'000;
+
+// Databases of PATTERNS from files of the working directory. Missing ones
+// are generated and saved if `generate`, otherwise nothing is returned
+std::vector<std::unique_ptr<PatternDatabase>> LoadPatternDatabases(
+    bool generate) {
+  std::vector<std::unique_ptr<PatternDatabase>> databases;
+  for (const auto &tiles : PATTERNS) {
+    std::string filename = "pdb";
+    for (int tile : tiles) {
+      filename += "_" + std::to_string(tile);
+    }
+    filename += ".bin";
+    databases.push_back(generate
+                            ? PatternDatabase::LoadOrGenerate(tiles, filename)
+                            : PatternDatabase::Load(tiles, filename));
+    if (!databases.back()) {
+      return {};
+    }
+  }
+  return databases;
+}
+
+// Solves every puzzle of the input, one answer per line. Puzzles are
+// solved in parallel, every thread reuses its own A* workspace. Pattern
+// databases are used if their files exist, and IDA* generates them only
+// when some puzzle is too hard without them.
+// A puzzle which can not be solved is answered by -1 and its error is
+// reported to stderr, as well as input which ends inside a puzzle or has
+// a non-number. Returns false if there were errors.
+bool solve(std::istream &in, std::ostream &out,
+           Puzzle15Solver::Search search = Puzzle15Solver::Search::IDAStar) {
+  std::vector<Puzzle15Solver::Table> tables;
   Puzzle15Solver::Table table;
-  for (int i = 0; i < Puzzle15Solver::TABLE_HEIGHT; ++i) {
-    for (int j = 0; j < Puzzle15Solver::TABLE_WIDTH; ++j) {
-      in >> table[i][j];
+  bool isInputValid = true;
+  while (true) {
+    int valuesCount = 0;
+    for (int i = 0; i < Puzzle15Solver::TABLE_HEIGHT; ++i) {
+      for (int j = 0; j < Puzzle15Solver::TABLE_WIDTH; ++j) {
+        valuesCount += bool(in >> table[i][j]);
+      }
+    }
+    if (valuesCount < Puzzle15Solver::N) {
+      isInputValid = (valuesCount == 0 && in.eof());
+      break;
     }
+    tables.push_back(table);
   }
-  out << Puzzle15Solver().GetNumberOfSteps(table) << '\n';
+
+  Puzzle15Solver solver;
+  auto databases = LoadPatternDatabases(false);
+  auto usePatternDatabases = [&] {
+    std::vector<const PatternDatabase *> pointers;
+    for (const auto &database : databases) {
+      pointers.push_back(database.get());
+    }
+    solver.SetPatternDatabases(pointers);
+  };
+  usePatternDatabases();
+
+  std::vector<std::optional<int64_t>> steps(tables.size());
+  std::vector<std::exception_ptr> errors(tables.size());
+  // Solves the puzzles without an answer yet, IDA* is limited to maxNodes
+  // nodes if it is positive
+  auto solveRemaining = [&](int64_t maxNodes) {
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+      Puzzle15Solver::Workspace workspace;
+      for (size_t i = next++; i < tables.size(); i = next++) {
+        if (steps[i] || errors[i]) {
+          continue;
+        }
+        try {
+          if (maxNodes > 0) {
+            steps[i] = solver.TryGetNumberOfSteps(tables[i], maxNodes);
+          } else {
+            steps[i] = solver.GetNumberOfSteps(tables[i], search, workspace);
+          }
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    };
+    size_t threadsCount = std::min<size_t>(
+        std::max(1u, std::thread::hardware_concurrency()), tables.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadsCount; ++t) {
+      threads.emplace_back(work);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  };
+
+  bool isLimited =
+      (databases.empty() && search == Puzzle15Solver::Search::IDAStar);
+  solveRemaining(isLimited ? MAX_NODES_WITHOUT_PATTERNS : 0);
+  for (size_t i = 0; isLimited && i < tables.size(); ++i) {
+    if (!steps[i] && !errors[i]) {
+      databases = LoadPatternDatabases(true);
+      usePatternDatabases();
+      solveRemaining(0);
+      break;
+    }
+  }
+  bool isSolved = isInputValid;
+  for (size_t i = 0; i < tables.size(); ++i) {
+    if (!errors[i]) {
+      out << *steps[i] << '\n';
+      continue;
+    }
+    isSolved = false;
+    out << -1 << '\n';
+    try {
+      std::rethrow_exception(errors[i]);
+    } catch (const std::exception &e) {
+      std::cerr << "Puzzle " << i + 1 << ": " << e.what() << '\n';
+    }
+  }
+  if (!isInputValid) {
+    std::cerr << "Puzzle " << tables.size() + 1
+              << ": The input ends inside it or has a non-number\n";
+  }
+  return isSolved;
 }
 
 int main() {
 #ifdef LOCAL
   std::ifstream fin("input.txt");
-  solve(fin, std::cout);
+  bool isSolved = solve(fin, std::cout);
 #else
-  solve(std::cin, std::cout);
+  bool isSolved = solve(std::cin, std::cout);
 #endif
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+  return isSolved ? EXIT_SUCCESS : EXIT_FAILURE;
+}
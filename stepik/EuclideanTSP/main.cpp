@@ -1,9 +1,10 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <numeric>
-#include <queue>
 #include <random>
 #include <unordered_map>
 #include <unordered_set>
@@ -16,6 +17,9 @@ public:
   Point2D(CoordType x, CoordType y) : _x(x), _y(y) {}
   Point2D() : _x(0), _y(0) {}
 
+  CoordType GetX() const { return _x; }
+  CoordType GetY() const { return _y; }
+
   CoordType Distance(const Point2D &other) const {
     return std::sqrt((other._x - _x) * (other._x - _x) +
                      (other._y - _y) * (other._y - _y));
@@ -30,45 +34,217 @@ private:
   CoordType _x, _y;
 };
 
-std::vector<std::pair<size_t, size_t>>
-FindMST(const std::vector<Point2D> &pts) {
+// Time and iteration budget of a search loop. The clock is read only once per
+// batch of iterations, so Tick() is cheap enough to be called on every move.
+// A cut-down copy of common/AnnealingSchedule.h, because stepik accepts a
+// single source file.
+class SearchBudget {
+public:
+  explicit SearchBudget(double maxTimeInSeconds,
+                        size_t maxIterations = std::numeric_limits<size_t>::max(),
+                        size_t batchSize = 1024)
+      : _maxTimeInMilliseconds(maxTimeInSeconds * 1000),
+        _maxIterations(maxIterations),
+        _batchSize(std::max<size_t>(1, batchSize)),
+        _start(std::chrono::steady_clock::now()) {}
+
+  // Counts one iteration. Returns false once the budget is exhausted.
+  bool Tick() {
+    if (++_iterations % _batchSize == 0 || _iterations >= _maxIterations) {
+      Refresh();
+    }
+    return _progress < 1.0;
+  }
+
+  // Fraction of the budget used so far, updated once per batch
+  double GetProgress() const { return _progress; }
+
+private:
+  double _maxTimeInMilliseconds;
+  size_t _maxIterations;
+  size_t _batchSize;
+  std::chrono::steady_clock::time_point _start;
+  size_t _iterations = 0;
+  double _progress = 0;
+
+  void Refresh() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - _start);
+    double timeProgress = elapsed.count() / _maxTimeInMilliseconds;
+    double iterationsProgress = (double)_iterations / _maxIterations;
+    _progress = std::min(1.0, std::max(timeProgress, iterationsProgress));
+  }
+};
+
+// Geometric temperature schedule of simulated annealing driven by the search
+// progress in [0, 1]: initTemp * (finalTemp / initTemp) ^ progress
+class AnnealingSchedule {
+public:
+  struct Params {
+    double initTemp = 1;
+    double finalTemp = 1e-3;
+  };
+
+  explicit AnnealingSchedule(const Params &params)
+      : _params(params), _temp(params.initTemp) {}
+
+  // Metropolis rule for a move which makes the objective worse by
+  // `worsening` (negative for improving moves)
+  template <class RandomEngine>
+  bool Accept(double worsening, RandomEngine &re) {
+    return worsening <= 0 || _unif(re) < std::exp(-worsening / _temp);
+  }
+
+  // Moves the schedule to the given progress. Cheap when progress has not
+  // changed, so it can be called on every iteration.
+  void Update(double progress) {
+    if (progress == _progress) {
+      return;
+    }
+    _progress = progress;
+    _temp = _params.initTemp *
+            std::pow(_params.finalTemp / _params.initTemp, progress);
+  }
+
+private:
+  Params _params;
+  double _temp;
+  double _progress = 0;
+  std::uniform_real_distribution<double> _unif{0.0, 1.0};
+};
+
+using Edge = std::pair<size_t, size_t>;
+using Graph = std::vector<std::vector<size_t>>;
+
+// Euclidean minimum spanning tree by array-based Prim: O(n^2) time and O(n)
+// memory. Edges are (parent, child) pairs.
+std::vector<Edge> FindMST(const std::vector<Point2D> &pts) {
   size_t ptCount = pts.size();
+  std::vector<Point2D::CoordType> key(
+      ptCount, std::numeric_limits<Point2D::CoordType>::infinity());
+  std::vector<size_t> parent(ptCount, 0);
   std::vector<bool> used(ptCount, false);
-  used[0] = true;
-  std::priority_queue<std::pair<Point2D::CoordType, std::pair<size_t, size_t>>>
-      q;
-  for (size_t i = 1; i < ptCount; ++i) {
-    q.push({-pts[0].Distance(pts[i]), {0, i}});
-  }
-  std::vector<std::pair<size_t, size_t>> mst;
-  while (!q.empty()) {
-    auto edge = q.top().second;
-    q.pop();
-    if (used[edge.second]) {
-      continue;
+  std::vector<Edge> mst;
+  mst.reserve(ptCount);
+  size_t next = 0;
+  for (size_t added = 0; added < ptCount; ++added) {
+    size_t v = next;
+    used[v] = true;
+    if (added) {
+      mst.push_back({parent[v], v});
     }
-    used[edge.second] = true;
-    mst.push_back(edge);
-    for (size_t i = 0; i < ptCount; ++i) {
-      if (!used[i]) {
-        q.push({-pts[edge.second].Distance(pts[i]), {edge.second, i}});
+    next = ptCount;
+    for (size_t u = 0; u < ptCount; ++u) {
+      if (used[u]) {
+        continue;
+      }
+      auto distance = pts[v].Distance(pts[u]);
+      if (distance < key[u]) {
+        key[u] = distance;
+        parent[u] = v;
+      }
+      if (next == ptCount || key[u] < key[next]) {
+        next = u;
       }
     }
   }
   return mst;
 }
 
-using Graph = std::vector<std::vector<size_t>>;
+// k nearest neighbours of every point. Points are swept in the order of x,
+// the sweep stops once the x distance exceeds the k-th best distance.
+Graph FindNearestNeighbors(const std::vector<Point2D> &pts, size_t k) {
+  size_t ptCount = pts.size();
+  std::vector<size_t> byX(ptCount);
+  std::iota(byX.begin(), byX.end(), 0);
+  std::sort(byX.begin(), byX.end(), [&](size_t a, size_t b) {
+    return pts[a].GetX() < pts[b].GetX();
+  });
+  Graph neighbors(ptCount);
+  std::vector<std::pair<Point2D::CoordType, size_t>> heap;
+  for (size_t i = 0; i < ptCount; ++i) {
+    size_t v = byX[i];
+    heap.clear();
+    auto visit = [&](size_t j) {
+      auto distance = pts[v].Distance(pts[byX[j]]);
+      if (heap.size() < k) {
+        heap.push_back({distance, byX[j]});
+        std::push_heap(heap.begin(), heap.end());
+      } else if (distance < heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {distance, byX[j]};
+        std::push_heap(heap.begin(), heap.end());
+      }
+    };
+    auto isFar = [&](size_t j) {
+      return heap.size() == k &&
+             std::abs(pts[byX[j]].GetX() - pts[v].GetX()) > heap.front().first;
+    };
+    for (size_t j = i + 1; j < ptCount && !isFar(j); ++j) {
+      visit(j);
+    }
+    for (size_t j = i; j-- > 0 && !isFar(j);) {
+      visit(j);
+    }
+    for (const auto &neighbor : heap) {
+      neighbors[v].push_back(neighbor.second);
+    }
+  }
+  return neighbors;
+}
 
-void Dfs(const Graph &g, size_t vertex, std::vector<bool> &used,
-         std::vector<size_t> &path) {
-  path.push_back(vertex);
-  used[vertex] = true;
-  for (auto to : g[vertex]) {
-    if (!used[to]) {
-      Dfs(g, to, used, path);
+class DisjointSets {
+public:
+  explicit DisjointSets(size_t count) : _parent(count) {
+    std::iota(_parent.begin(), _parent.end(), 0);
+  }
+
+  size_t Find(size_t v) {
+    while (_parent[v] != v) {
+      v = _parent[v] = _parent[_parent[v]];
+    }
+    return v;
+  }
+
+  bool Unite(size_t a, size_t b) {
+    a = Find(a);
+    b = Find(b);
+    if (a == b) {
+      return false;
+    }
+    _parent[a] = b;
+    return true;
+  }
+
+private:
+  std::vector<size_t> _parent;
+};
+
+// Kruskal over the k-nearest-neighbour graph in O(nk log(nk)) time and O(nk)
+// memory. For typical inputs this graph contains the EMST; if it is not
+// connected, fewer than n - 1 edges are returned.
+std::vector<Edge> FindSparseMST(const std::vector<Point2D> &pts, size_t k) {
+  auto neighbors = FindNearestNeighbors(pts, k);
+  std::vector<std::pair<Point2D::CoordType, Edge>> edges;
+  for (size_t v = 0; v < pts.size(); ++v) {
+    for (size_t u : neighbors[v]) {
+      if (v < u) {
+        edges.push_back({pts[v].Distance(pts[u]), {v, u}});
+      } else if (std::find(neighbors[u].begin(), neighbors[u].end(), v) ==
+                 neighbors[u].end()) {
+        edges.push_back({pts[v].Distance(pts[u]), {u, v}});
+      }
     }
   }
+  std::sort(edges.begin(), edges.end());
+  DisjointSets sets(pts.size());
+  std::vector<Edge> mst;
+  for (const auto &edge : edges) {
+    if (sets.Unite(edge.second.first, edge.second.second)) {
+      mst.push_back(edge.second);
+    }
+  }
+  return mst;
 }
 
 Point2D::CoordType ComputeTourDistance(const std::vector<Point2D> &pts,
@@ -80,37 +256,141 @@ Point2D::CoordType ComputeTourDistance(const std::vector<Point2D> &pts,
   return distance;
 }
 
-std::vector<size_t> GetCycle(const Graph &g, const std::vector<Point2D> &pts) {
+// Preorder walk of the tree from vertex 0 in a single pass, without recursion
+std::vector<size_t> GetCycle(const Graph &g) {
   size_t nodesCount = g.size();
   std::vector<size_t> path;
+  path.reserve(nodesCount);
   std::vector<bool> used(nodesCount, false);
-  std::vector<size_t> bestCycle;
-  Point2D::CoordType bestDistance = 0;
-  for (size_t i = 0; i < nodesCount; ++i) {
-    path.clear();
-    std::fill(used.begin(), used.end(), false);
-    Dfs(g, i, used, path);
-    auto currentDistance = ComputeTourDistance(pts, path);
-    if (!i || bestDistance > currentDistance) {
-      bestCycle = path;
-      bestDistance = currentDistance;
-    }
-  }
-  return bestCycle;
+  std::vector<size_t> stack = {0};
+  used[0] = true;
+  while (!stack.empty()) {
+    size_t vertex = stack.back();
+    stack.pop_back();
+    path.push_back(vertex);
+    for (auto it = g[vertex].rbegin(); it != g[vertex].rend(); ++it) {
+      if (!used[*it]) {
+        used[*it] = true;
+        stack.push_back(*it);
+      }
+    }
+  }
+  return path;
+}
+
+// Christofides-style tour: odd-degree vertices of the tree are matched
+// greedily to their nearest unmatched odd vertex (O(n^2), not a minimum
+// matching), then an Euler circuit of tree plus matching is shortcut.
+std::vector<size_t> GetMatchedCycle(const std::vector<Edge> &mst,
+                                    const std::vector<Point2D> &pts) {
+  size_t ptCount = pts.size();
+  std::vector<Edge> edges = mst;
+  std::vector<size_t> degree(ptCount, 0);
+  for (const auto &e : mst) {
+    degree[e.first]++;
+    degree[e.second]++;
+  }
+  std::vector<size_t> odd;
+  for (size_t v = 0; v < ptCount; ++v) {
+    if (degree[v] % 2) {
+      odd.push_back(v);
+    }
+  }
+  std::vector<bool> matched(odd.size(), false);
+  for (size_t i = 0; i < odd.size(); ++i) {
+    if (matched[i]) {
+      continue;
+    }
+    size_t nearest = odd.size();
+    for (size_t j = i + 1; j < odd.size(); ++j) {
+      if (!matched[j] &&
+          (nearest == odd.size() ||
+           pts[odd[i]].Distance(pts[odd[j]]) <
+               pts[odd[i]].Distance(pts[odd[nearest]]))) {
+        nearest = j;
+      }
+    }
+    matched[i] = matched[nearest] = true;
+    edges.push_back({odd[i], odd[nearest]});
+  }
+
+  // Hierholzer's algorithm over edge indices
+  std::vector<std::vector<std::pair<size_t, size_t>>> incident(ptCount);
+  for (size_t e = 0; e < edges.size(); ++e) {
+    incident[edges[e].first].push_back({edges[e].second, e});
+    incident[edges[e].second].push_back({edges[e].first, e});
+  }
+  std::vector<bool> usedEdge(edges.size(), false);
+  std::vector<size_t> next(ptCount, 0);
+  std::vector<size_t> stack = {0};
+  std::vector<bool> visited(ptCount, false);
+  std::vector<size_t> cycle;
+  cycle.reserve(ptCount);
+  while (!stack.empty()) {
+    size_t v = stack.back();
+    while (next[v] < incident[v].size() && usedEdge[incident[v][next[v]].second]) {
+      next[v]++;
+    }
+    if (next[v] == incident[v].size()) {
+      stack.pop_back();
+      if (!visited[v]) {
+        visited[v] = true;
+        cycle.push_back(v);
+      }
+    } else {
+      usedEdge[incident[v][next[v]].second] = true;
+      stack.push_back(incident[v][next[v]].first);
+    }
+  }
+  return cycle;
+}
+
+// Change of the tour length after reversing tour positions [l, r]. Only the
+// two edges at the ends of the segment change, so it takes O(1).
+Point2D::CoordType ComputeReverseDelta(const std::vector<Point2D> &pts,
+                                       const std::vector<size_t> &tour,
+                                       size_t l, size_t r) {
+  size_t n = tour.size();
+  if (l == r || (l == 0 && r + 1 == n)) {
+    return 0;
+  }
+  const Point2D &prev = pts[tour[(l + n - 1) % n]];
+  const Point2D &first = pts[tour[l]];
+  const Point2D &last = pts[tour[r]];
+  const Point2D &next = pts[tour[(r + 1) % n]];
+  return prev.Distance(last) + first.Distance(next) - prev.Distance(first) -
+         last.Distance(next);
 }
 
 using Solution = std::pair<Point2D::CoordType, std::vector<size_t>>;
 
 Solution MSTSolution(const std::vector<Point2D> &pts) {
+  // Above this size O(n^2) stages are replaced by nearest-neighbour ones
+  const size_t DENSE_LIMIT = 5000;
   size_t ptCount = pts.size();
-  auto mst = FindMST(pts);
+  std::vector<Edge> mst;
+  if (ptCount > DENSE_LIMIT) {
+    mst = FindSparseMST(pts, 10);
+  }
+  if (mst.size() + 1 != ptCount) {
+    mst = FindMST(pts);
+  }
   Graph tree(ptCount);
   for (const auto &e : mst) {
     tree[e.first].push_back(e.second);
     tree[e.second].push_back(e.first);
   }
-  auto cycle = GetCycle(tree, pts);
-  return {ComputeTourDistance(pts, cycle), cycle};
+  Solution best;
+  best.second = GetCycle(tree);
+  best.first = ComputeTourDistance(pts, best.second);
+  if (ptCount <= DENSE_LIMIT) {
+    auto matched = GetMatchedCycle(mst, pts);
+    auto distance = ComputeTourDistance(pts, matched);
+    if (distance < best.first) {
+      best = {distance, matched};
+    }
+  }
+  return best;
 }
 
 Solution LocalSearchSolution(const std::vector<Point2D> &pts) {
@@ -120,51 +400,115 @@ Solution LocalSearchSolution(const std::vector<Point2D> &pts) {
   auto bestSolution = init.second;
   auto currentDistance = init.first;
   auto currentSolution = init.second;
-  std::uniform_real_distribution<long double> unif(0, 1);
   std::uniform_int_distribution<size_t> ind(0, pts.size() - 1);
   std::random_device rand_dev;
   std::mt19937 rand_engine(rand_dev());
-  long double temp = 5000;
-  for (size_t it = 0; it < 6000000; ++it) {
+  // Temperatures are relative to an average edge of the initial tour
+  AnnealingSchedule::Params params;
+  params.initTemp = 0.5 * init.first / pts.size();
+  params.finalTemp = 1e-3 * params.initTemp;
+  AnnealingSchedule schedule(params);
+  SearchBudget budget(std::numeric_limits<double>::infinity(), 6000000);
+  while (budget.Tick()) {
+    schedule.Update(budget.GetProgress());
     size_t l = ind(rand_engine);
     size_t r = ind(rand_engine);
     if (l > r) {
       std::swap(l, r);
     }
-    auto next = currentSolution;
-    std::reverse(next.begin() + l, next.begin() + r + 1);
-    Point2D::CoordType nextDistance = ComputeTourDistance(pts, next);
-    auto delta = (nextDistance - currentDistance) / nextDistance;
-    auto prob = std::exp(-delta / temp);
-    if (nextDistance < currentDistance || unif(rand_engine) < prob) {
-      currentDistance = nextDistance;
-      currentSolution = next;
-      if (currentDistance < bestDistance) {
+    if (l == r || (l == 0 && r + 1 == pts.size())) {
+      continue;
+    }
+    Point2D::CoordType delta =
+        ComputeReverseDelta(pts, currentSolution, l, r);
+    if (schedule.Accept(delta, rand_engine)) {
+      std::reverse(currentSolution.begin() + l, currentSolution.begin() + r + 1);
+      currentDistance += delta;
+      if (currentDistance < bestDistance - 1e-9) {
         std::cerr << "New distance found: " << currentDistance << '\r';
         bestSolution = currentSolution;
         bestDistance = currentDistance;
-      } else {
-        temp *= 0.99996;
       }
     }
   }
   return {bestDistance, bestSolution};
 }
 
-Solution BruteForceSolution(const std::vector<Point2D> &pts) {
+// Exact solution by Held-Karp dynamic programming in O(2^n n^2) time and
+// O(2^n n) memory. City 0 starts the tour; dp[mask * m + last] is the length
+// of the shortest path from city 0 through the cities of `mask` (bit i stands
+// for city i + 1) which ends at city last + 1. Subsets are processed in
+// increasing order, so every row reads only smaller, already computed rows.
+Solution HeldKarpSolution(const std::vector<Point2D> &pts) {
   size_t ptCount = pts.size();
-  std::vector<size_t> perm(ptCount);
-  std::iota(perm.begin(), perm.end(), 0);
-  std::vector<size_t> bestSolution = perm;
-  Point2D::CoordType bestDistance = ComputeTourDistance(pts, perm);
-  while (std::next_permutation(perm.begin(), perm.end())) {
-    auto currentDistance = ComputeTourDistance(pts, perm);
-    if (currentDistance < bestDistance) {
-      bestSolution = perm;
-      bestDistance = currentDistance;
+  std::vector<size_t> tour(ptCount);
+  std::iota(tour.begin(), tour.end(), 0);
+  if (ptCount < 4) {
+    return {ComputeTourDistance(pts, tour), tour};
+  }
+  const size_t m = ptCount - 1;
+  const float INF = std::numeric_limits<float>::infinity();
+  std::vector<float> dist(ptCount * ptCount);
+  for (size_t i = 0; i < ptCount; ++i) {
+    for (size_t j = 0; j < ptCount; ++j) {
+      dist[i * ptCount + j] = pts[i].Distance(pts[j]);
     }
   }
-  return {bestDistance, bestSolution};
+  auto cityDist = [&](size_t i, size_t j) {
+    return dist[(i + 1) * ptCount + j + 1];
+  };
+  // Shortest way to reach `last` through `mask` from a computed row
+  std::vector<float> dp((size_t(1) << m) * m, INF);
+  auto relax = [&](size_t mask, size_t last, size_t &from) {
+    size_t prev = mask ^ (size_t(1) << last);
+    const float *row = &dp[prev * m];
+    float best = INF;
+    for (size_t k = 0; k < m; ++k) {
+      if (prev >> k & 1) {
+        float length = row[k] + cityDist(k, last);
+        if (length < best) {
+          best = length;
+          from = k;
+        }
+      }
+    }
+    return best;
+  };
+  for (size_t last = 0; last < m; ++last) {
+    dp[(size_t(1) << last) * m + last] = dist[last + 1];
+  }
+  const size_t full = (size_t(1) << m) - 1;
+  for (size_t mask = 1; mask <= full; ++mask) {
+    if (!(mask & (mask - 1))) {
+      continue;
+    }
+    float *row = &dp[mask * m];
+    for (size_t last = 0; last < m; ++last) {
+      if (mask >> last & 1) {
+        size_t from;
+        row[last] = relax(mask, last, from);
+      }
+    }
+  }
+
+  size_t last = 0;
+  for (size_t k = 1; k < m; ++k) {
+    if (dp[full * m + k] + dist[k + 1] < dp[full * m + last] + dist[last + 1]) {
+      last = k;
+    }
+  }
+  size_t mask = full;
+  for (size_t pos = ptCount - 1; pos > 0; --pos) {
+    tour[pos] = last + 1;
+    size_t from = last;
+    if (mask & (mask - 1)) {
+      relax(mask, last, from);
+    }
+    mask ^= size_t(1) << last;
+    last = from;
+  }
+  tour[0] = 0;
+  return {ComputeTourDistance(pts, tour), tour};
 }
 
 void solve(std::istream &in, std::ostream &out) {
@@ -178,8 +522,8 @@ void solve(std::istream &in, std::ostream &out) {
     idByInd[i] = id;
   }
   Solution solution;
-  if (ptCount <= 12) {
-    solution = BruteForceSolution(pts);
+  if (ptCount <= 20) {
+    solution = HeldKarpSolution(pts);
   } else {
     solution = LocalSearchSolution(pts);
   }
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../common/AnnealingSchedule.h"
+
+// Search state which is enough to continue a search in another run: the best
+// tour and, for annealing, random engine and schedule of every chain.
+//
+// Binary layout (little-endian as written by the host):
+//   uint32 magic, uint32 version, uint32 cityCount, double distance,
+//   uint32 tour[cityCount], uint32 chainCount, and for every chain
+//   uint32 randomStateLength, char randomState[randomStateLength],
+//   double temp, startTemp, startProgress, progress,
+//   uint64 accepted, sinceImprovement
+struct Checkpoint {
+    struct Chain {
+        // Random engine serialized by operator<<
+        std::string randomState;
+        AnnealingSchedule::State schedule;
+    };
+
+    double distance = 0;
+    std::vector<size_t> tour;
+    std::vector<Chain> chains;
+
+    // Writes a temporary file next to `filename` and renames it, so the
+    // previous checkpoint stays intact if the process is killed meanwhile
+    void Save(const std::string& filename) const {
+        const std::string tmpFilename = filename + ".tmp";
+        {
+            std::ofstream out(tmpFilename, std::ios::binary);
+            Write<uint32_t>(out, MAGIC);
+            Write<uint32_t>(out, VERSION);
+            Write<uint32_t>(out, tour.size());
+            Write<double>(out, distance);
+            std::vector<uint32_t> packed(tour.begin(), tour.end());
+            out.write(reinterpret_cast<const char*>(packed.data()),
+                      packed.size() * sizeof(uint32_t));
+            Write<uint32_t>(out, chains.size());
+            for (const auto& chain : chains) {
+                Write<uint32_t>(out, chain.randomState.size());
+                out.write(chain.randomState.data(), chain.randomState.size());
+                Write<double>(out, chain.schedule.temp);
+                Write<double>(out, chain.schedule.startTemp);
+                Write<double>(out, chain.schedule.startProgress);
+                Write<double>(out, chain.schedule.progress);
+                Write<uint64_t>(out, chain.schedule.accepted);
+                Write<uint64_t>(out, chain.schedule.sinceImprovement);
+            }
+            if (!out) {
+                throw std::runtime_error("Failed to write checkpoint " +
+                                         tmpFilename);
+            }
+        }
+        if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace checkpoint " +
+                                     filename);
+        }
+    }
+
+    // Reads a binary checkpoint or a text answer in the output format
+    // ("<distance> <optimal>" followed by the tour), e.g. from answers/
+    static Checkpoint Load(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        Checkpoint checkpoint;
+        if (Read<uint32_t>(in) != MAGIC) {
+            in.clear();
+            in.seekg(0);
+            int isOptimal;
+            in >> checkpoint.distance >> isOptimal;
+            size_t index;
+            while (in >> index) {
+                checkpoint.tour.push_back(index);
+            }
+            if (checkpoint.tour.empty()) {
+                throw std::runtime_error("No tour found in " + filename);
+            }
+            return checkpoint;
+        }
+        if (Read<uint32_t>(in) != VERSION) {
+            throw std::runtime_error("Unsupported checkpoint version in " +
+                                     filename);
+        }
+        std::vector<uint32_t> packed(Read<uint32_t>(in));
+        checkpoint.distance = Read<double>(in);
+        in.read(reinterpret_cast<char*>(packed.data()),
+                packed.size() * sizeof(uint32_t));
+        checkpoint.tour.assign(packed.begin(), packed.end());
+        checkpoint.chains.resize(Read<uint32_t>(in));
+        for (auto& chain : checkpoint.chains) {
+            chain.randomState.resize(Read<uint32_t>(in));
+            in.read(&chain.randomState[0], chain.randomState.size());
+            chain.schedule.temp = Read<double>(in);
+            chain.schedule.startTemp = Read<double>(in);
+            chain.schedule.startProgress = Read<double>(in);
+            chain.schedule.progress = Read<double>(in);
+            chain.schedule.accepted = Read<uint64_t>(in);
+            chain.schedule.sinceImprovement = Read<uint64_t>(in);
+        }
+        if (!in) {
+            throw std::runtime_error("Truncated checkpoint " + filename);
+        }
+        return checkpoint;
+    }
+
+    template <class RandomEngine>
+    static std::string SaveRandomState(const RandomEngine& re) {
+        std::ostringstream out;
+        out << re;
+        return out.str();
+    }
+
+    template <class RandomEngine>
+    static void LoadRandomState(const std::string& state, RandomEngine& re) {
+        std::istringstream in(state);
+        in >> re;
+    }
+
+   private:
+    // "TSPC"
+    constexpr static uint32_t MAGIC = 0x43505354;
+    constexpr static uint32_t VERSION = 1;
+
+    template <class T>
+    static void Write(std::ostream& out, T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    static T Read(std::istream& in) {
+        T value{};
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+// Length of the best known tour and the best lower bound, shared between the
+// search threads and the lower bound thread
+class GapMonitor {
+   public:
+    explicit GapMonitor(double targetGap = 0) : _targetGap(targetGap) {}
+
+    void ReportTour(double length) {
+        double current = _upperBound.load();
+        while (length < current &&
+               !_upperBound.compare_exchange_weak(current, length)) {
+        }
+    }
+
+    void ReportBound(double bound) {
+        double current = _lowerBound.load();
+        while (bound > current &&
+               !_lowerBound.compare_exchange_weak(current, bound)) {
+        }
+    }
+
+    double GetUpperBound() const { return _upperBound.load(); }
+    double GetLowerBound() const { return _lowerBound.load(); }
+
+    // Relative distance between the best tour and the lower bound
+    double GetGap() const {
+        double lower = GetLowerBound();
+        if (lower <= 0) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return (GetUpperBound() - lower) / lower;
+    }
+
+    bool IsGapReached() const {
+        return GetGap() <= std::max(_targetGap, OPTIMALITY_GAP);
+    }
+
+    bool IsOptimal() const { return GetGap() <= OPTIMALITY_GAP; }
+
+    void Stop() { _stopped = true; }
+    bool IsStopped() const { return _stopped.load(); }
+
+   private:
+    // Tour lengths are not exact, smaller gaps are treated as optimality
+    constexpr static double OPTIMALITY_GAP = 1e-9;
+
+    double _targetGap;
+    std::atomic<double> _upperBound{std::numeric_limits<double>::infinity()};
+    std::atomic<double> _lowerBound{0};
+    std::atomic<bool> _stopped{false};
+};
@@ -0,0 +1,656 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../../common/AnnealingSchedule.h"
+#include "LocalSearchSolver.h"
+
+// 2-opt local search over nearest neighbour candidate lists with don't-look
+// bits. Tours are arrays of cities, a move reverses the shorter side.
+class TwoOptOptimizer {
+   public:
+    TwoOptOptimizer(const std::vector<Vector>& pts,
+                    const std::vector<std::vector<size_t>>& neighbors)
+        : _pts(pts), _neighbors(neighbors) {}
+
+    // Applies improving moves until none of the candidate moves improves.
+    // Returns the total decrease of the tour length.
+    Vector::CoordType Optimize(std::vector<size_t>& tour) const {
+        const size_t ptCount = tour.size();
+        if (ptCount < 5) {
+            return 0;
+        }
+        std::vector<size_t> pos(ptCount);
+        for (size_t i = 0; i < ptCount; ++i) {
+            pos[tour[i]] = i;
+        }
+        std::vector<char> queued(ptCount, true);
+        std::vector<size_t> queue(tour.rbegin(), tour.rend());
+        Vector::CoordType gain = 0;
+        while (!queue.empty()) {
+            size_t a = queue.back();
+            queue.pop_back();
+            queued[a] = false;
+            Vector::CoordType moveGain = ImproveCity(a, tour, pos, queue, queued);
+            if (moveGain > 0) {
+                gain += moveGain;
+                if (!queued[a]) {
+                    queued[a] = true;
+                    queue.push_back(a);
+                }
+            }
+        }
+        return gain;
+    }
+
+   private:
+    const Vector::CoordType EPS = 1e-9;
+
+    const std::vector<Vector>& _pts;
+    const std::vector<std::vector<size_t>>& _neighbors;
+
+    Vector::CoordType Distance(size_t p1, size_t p2) const {
+        return Vector::ComputeDistance(_pts[p1], _pts[p2]);
+    }
+
+    // Tries moves which add an edge from `a` to one of its candidates.
+    // Applies the first improving one and returns its gain.
+    Vector::CoordType ImproveCity(size_t a,
+                                  std::vector<size_t>& tour,
+                                  std::vector<size_t>& pos,
+                                  std::vector<size_t>& queue,
+                                  std::vector<char>& queued) const {
+        const size_t ptCount = tour.size();
+        auto next = [&](size_t v) { return tour[(pos[v] + 1) % ptCount]; };
+        auto prev = [&](size_t v) {
+            return tour[(pos[v] + ptCount - 1) % ptCount];
+        };
+        for (int forward = 1; forward >= 0; --forward) {
+            size_t b = (forward ? next(a) : prev(a));
+            Vector::CoordType ab = Distance(a, b);
+            for (size_t c : _neighbors[a]) {
+                Vector::CoordType g1 = ab - Distance(a, c);
+                if (g1 <= EPS) {
+                    break;
+                }
+                size_t d = (forward ? next(c) : prev(c));
+                if (c == b || d == a) {
+                    continue;
+                }
+                Vector::CoordType gain = g1 + Distance(c, d) - Distance(b, d);
+                if (gain <= EPS) {
+                    continue;
+                }
+                // Edges (a, b) and (c, d) are replaced by (a, c) and (b, d)
+                if (forward) {
+                    Reverse(tour, pos, pos[b], pos[c]);
+                } else {
+                    Reverse(tour, pos, pos[a], pos[d]);
+                }
+                for (size_t v : {b, c, d}) {
+                    if (!queued[v]) {
+                        queued[v] = true;
+                        queue.push_back(v);
+                    }
+                }
+                return gain;
+            }
+        }
+        return 0;
+    }
+
+    // Reverses the cyclic tour part from position `from` to position `to`
+    static void Reverse(std::vector<size_t>& tour,
+                        std::vector<size_t>& pos,
+                        size_t from,
+                        size_t to) {
+        const size_t ptCount = tour.size();
+        size_t length = (to + ptCount - from) % ptCount + 1;
+        if (2 * length > ptCount) {
+            // Reversing the complement gives the same cyclic tour
+            std::swap(from, to);
+            from = (from + 1) % ptCount;
+            to = (to + ptCount - 1) % ptCount;
+            length = ptCount - length;
+        }
+        for (size_t k = 0; k < length / 2; ++k) {
+            size_t i = (from + k) % ptCount;
+            size_t j = (to + ptCount - k) % ptCount;
+            std::swap(tour[i], tour[j]);
+            pos[tour[i]] = i;
+            pos[tour[j]] = j;
+        }
+    }
+};
+
+// Genetic algorithm over a population of 2-opt optimal tours. Parent pairs
+// are recombined by edge assembly crossover (EAX) or order crossover (OX);
+// offspring of a generation are generated and evaluated in parallel.
+class GeneticSolver {
+   public:
+    using Solution = LocalSearchSolver::Solution;
+
+    enum class Crossover { EdgeAssembly, Order };
+
+    struct Params {
+        size_t populationSize = 100;
+        // Children generated from every parent pair, the best one replaces
+        // the first parent if it is shorter
+        size_t childrenCount = 30;
+        size_t neighborsCount = 10;
+        size_t threadsCount = 1;
+        size_t maxStagnantGenerations = 50;
+        Crossover crossover = Crossover::EdgeAssembly;
+    };
+
+    GeneticSolver(const std::vector<Vector>& pts, const Params& params)
+        : _pts(pts),
+          _params(params),
+          _neighbors(ComputeNearestNeighbors(pts, params.neighborsCount)),
+          _hilbertOrder(ComputeHilbertOrder(pts)),
+          _optimizer(_pts, _neighbors) {}
+
+    // See LocalSearchSolver::SetGapMonitor
+    void SetGapMonitor(GapMonitor* monitor) { _monitor = monitor; }
+
+    // Replaces the geometric neighbor lists used by 2-opt, greedy tours and
+    // subtour merging. Lists are ordered by distance, as 2-opt expects.
+    void SetCandidates(std::vector<std::vector<size_t>> candidates) {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            std::sort(candidates[i].begin(), candidates[i].end(),
+                      [&](size_t a, size_t b) {
+                          return Distance(i, a) < Distance(i, b);
+                      });
+        }
+        _neighbors = std::move(candidates);
+    }
+
+    // See LocalSearchSolver::SetCheckpointHandler. Checkpoints of the genetic
+    // search only contain the best tour.
+    void SetCheckpointHandler(LocalSearchSolver::CheckpointHandler handler,
+                              size_t intervalInMilliseconds) {
+        _checkpointHandler = std::move(handler);
+        _checkpointIntervalInMilliseconds = intervalInMilliseconds;
+    }
+
+    // The checkpoint tour replaces one member of the initial population
+    void SetStart(Checkpoint checkpoint) { _start = std::move(checkpoint); }
+
+    Solution FindSolution(size_t maxTimeInSeconds = 60 * 10) const {
+        const size_t ptCount = _pts.size();
+        if (ptCount < 8) {
+            // Too few cities for crossovers, the settings of the search are
+            // handed over to the local search
+            LocalSearchSolver solver(_pts);
+            solver.SetGapMonitor(_monitor);
+            solver.SetCheckpointHandler(_checkpointHandler,
+                                        _checkpointIntervalInMilliseconds);
+            if (_start) {
+                solver.SetStart(*_start);
+            }
+            return solver.FindSolution(std::min<size_t>(maxTimeInSeconds, 1));
+        }
+        SearchBudget budget(maxTimeInSeconds, std::numeric_limits<size_t>::max(),
+                            1);
+        std::default_random_engine re;
+        const size_t populationSize = std::max<size_t>(2, _params.populationSize);
+        std::vector<Solution> population(populationSize);
+        RunInParallel(populationSize, re(), [&](size_t i, std::mt19937& rng) {
+            if (i == 0 && _start) {
+                population[i].indices = _start->tour;
+                population[i].distance = ComputeTourDistance(_start->tour);
+            } else {
+                population[i] = RandomizedGreedySolution(rng);
+            }
+            population[i].distance -= _optimizer.Optimize(population[i].indices);
+        });
+        Solution best = *std::min_element(population.begin(), population.end(),
+                                          ShorterSolution);
+        std::cerr << "Initial population created. Distance: " << std::fixed
+                  << best.distance << std::endl;
+
+        std::vector<size_t> order(populationSize);
+        std::iota(order.begin(), order.end(), 0);
+        std::vector<Solution> children(populationSize);
+        size_t stagnantGenerations = 0;
+        size_t lastCheckpoint = 0;
+        while (budget.Tick() &&
+               stagnantGenerations < _params.maxStagnantGenerations) {
+            std::shuffle(order.begin(), order.end(), re);
+            RunInParallel(populationSize, re(), [&](size_t i, std::mt19937& rng) {
+                const auto& first = population[order[i]];
+                const auto& second = population[order[(i + 1) % populationSize]];
+                children[i] =
+                    (_params.crossover == Crossover::EdgeAssembly
+                         ? EdgeAssemblyCrossover(first, second, rng)
+                         : OrderCrossover(first, second, rng));
+            });
+            bool improved = false;
+            for (size_t i = 0; i < populationSize; ++i) {
+                auto& parent = population[order[i]];
+                if (!children[i].indices.empty() &&
+                    children[i].distance < parent.distance - EPS) {
+                    parent = std::move(children[i]);
+                    if (parent.distance < best.distance - EPS) {
+                        best = parent;
+                        improved = true;
+                    }
+                }
+                children[i].indices.clear();
+            }
+            if (improved) {
+                stagnantGenerations = 0;
+                std::cerr << "New distance found: " << std::fixed
+                          << best.distance << '\r';
+            } else {
+                stagnantGenerations++;
+            }
+            if (_checkpointHandler &&
+                budget.GetElapsedMilliseconds() >=
+                    lastCheckpoint + _checkpointIntervalInMilliseconds) {
+                lastCheckpoint = budget.GetElapsedMilliseconds();
+                SaveCheckpoint(best);
+            }
+            if (_monitor) {
+                _monitor->ReportTour(best.distance);
+                if (_monitor->IsGapReached()) {
+                    break;
+                }
+            }
+        }
+        SaveCheckpoint(best);
+        return best;
+    }
+
+   private:
+    using Links = std::vector<std::array<size_t, 2>>;
+
+    static const size_t NONE = std::numeric_limits<size_t>::max();
+    const Vector::CoordType EPS = 1e-6;
+
+    const std::vector<Vector>& _pts;
+    Params _params;
+    std::vector<std::vector<size_t>> _neighbors;
+    std::vector<size_t> _hilbertOrder;
+    TwoOptOptimizer _optimizer;
+    GapMonitor* _monitor = nullptr;
+    LocalSearchSolver::CheckpointHandler _checkpointHandler;
+    size_t _checkpointIntervalInMilliseconds = 0;
+    std::optional<Checkpoint> _start;
+
+    void SaveCheckpoint(const Solution& best) const {
+        if (_checkpointHandler) {
+            Checkpoint checkpoint;
+            checkpoint.distance = best.distance;
+            checkpoint.tour = best.indices;
+            _checkpointHandler(checkpoint);
+        }
+    }
+
+    static bool ShorterSolution(const Solution& s1, const Solution& s2) {
+        return s1.distance < s2.distance;
+    }
+
+    Vector::CoordType Distance(size_t p1, size_t p2) const {
+        return Vector::ComputeDistance(_pts[p1], _pts[p2]);
+    }
+
+    Vector::CoordType ComputeTourDistance(const std::vector<size_t>& tour) const {
+        Vector::CoordType length = 0;
+        for (size_t i = 0; i < tour.size(); ++i) {
+            length += Distance(tour[i], tour[(i + 1) % tour.size()]);
+        }
+        return length;
+    }
+
+    // Calls job(i, rng) for every i in [0, count), spreading the indices over
+    // the worker threads. Every thread gets its own seeded engine.
+    template <class Job>
+    void RunInParallel(size_t count, unsigned seed, Job job) const {
+        size_t threadsCount =
+            std::max<size_t>(1, std::min(_params.threadsCount, count));
+        auto worker = [&](size_t t) {
+            std::mt19937 rng(seed + t);
+            for (size_t i = t; i < count; i += threadsCount) {
+                job(i, rng);
+            }
+        };
+        if (threadsCount == 1) {
+            worker(0);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadsCount; ++t) {
+            threads.emplace_back(worker, t);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // Nearest neighbour tour from a random city which sometimes takes the
+    // second nearest candidate. When all candidates are visited the next
+    // unvisited city in Hilbert order is taken.
+    Solution RandomizedGreedySolution(std::mt19937& rng) const {
+        const size_t ptCount = _pts.size();
+        std::uniform_int_distribution<size_t> unif_ind(0, ptCount - 1);
+        std::bernoulli_distribution takeSecond(0.1);
+        std::vector<char> used(ptCount, false);
+        Solution s;
+        s.indices.reserve(ptCount);
+        size_t current = unif_ind(rng);
+        size_t hilbertPos = 0;
+        while (true) {
+            used[current] = true;
+            s.indices.push_back(current);
+            if (s.indices.size() == ptCount) {
+                break;
+            }
+            size_t next = NONE;
+            bool skipFirst = takeSecond(rng);
+            for (size_t candidate : _neighbors[current]) {
+                if (!used[candidate]) {
+                    next = candidate;
+                    if (!skipFirst) {
+                        break;
+                    }
+                    skipFirst = false;
+                }
+            }
+            while (next == NONE) {
+                if (!used[_hilbertOrder[hilbertPos]]) {
+                    next = _hilbertOrder[hilbertPos];
+                }
+                hilbertPos++;
+            }
+            current = next;
+        }
+        s.distance = ComputeTourDistance(s.indices);
+        return s;
+    }
+
+    static Links ComputeLinks(const std::vector<size_t>& tour) {
+        const size_t ptCount = tour.size();
+        Links links(ptCount);
+        for (size_t i = 0; i < ptCount; ++i) {
+            links[tour[i]] = {tour[(i + ptCount - 1) % ptCount],
+                              tour[(i + 1) % ptCount]};
+        }
+        return links;
+    }
+
+    static bool HasLink(const Links& links, size_t u, size_t v) {
+        return links[u][0] == v || links[u][1] == v;
+    }
+
+    static void ReplaceLink(Links& links, size_t u, size_t from, size_t to) {
+        links[u][links[u][0] == from ? 0 : 1] = to;
+    }
+
+    // Splits the edges of `first` not in `second` (A-edges) and of `second`
+    // not in `first` (B-edges) into AB-cycles: closed walks which alternate
+    // A- and B-edges. Edge i of a returned cycle is an A-edge for even i.
+    std::vector<std::vector<size_t>> FindABCycles(const Links& linkA,
+                                                  const Links& linkB,
+                                                  std::mt19937& rng) const {
+        const size_t ptCount = linkA.size();
+        // rest[0] are unused A-edges, rest[1] are unused B-edges
+        std::array<Links, 2> rest = {Links(ptCount, {NONE, NONE}),
+                                     Links(ptCount, {NONE, NONE})};
+        std::array<std::vector<int>, 2> restCount = {
+            std::vector<int>(ptCount, 0), std::vector<int>(ptCount, 0)};
+        for (size_t u = 0; u < ptCount; ++u) {
+            for (size_t v : linkA[u]) {
+                if (!HasLink(linkB, u, v)) {
+                    rest[0][u][restCount[0][u]++] = v;
+                }
+            }
+            for (size_t v : linkB[u]) {
+                if (!HasLink(linkA, u, v)) {
+                    rest[1][u][restCount[1][u]++] = v;
+                }
+            }
+        }
+        auto takeEdge = [&](int type, size_t u) {
+            size_t slot = (restCount[type][u] == 2 ? rng() % 2 : 0);
+            size_t v = rest[type][u][slot];
+            rest[type][u][slot] = rest[type][u][--restCount[type][u]];
+            restCount[type][v]--;
+            size_t vSlot = (rest[type][v][0] == u ? 0 : 1);
+            rest[type][v][vSlot] = rest[type][v][restCount[type][v]];
+            return v;
+        };
+
+        // Positions of every city on the current walk, at most 3 of them
+        std::vector<std::array<size_t, 3>> walkPos(ptCount);
+        std::vector<int> walkPosCount(ptCount, 0);
+        std::vector<std::vector<size_t>> cycles;
+        std::vector<size_t> walk;
+        size_t offset = rng() % ptCount;
+        for (size_t s = 0; s < ptCount; ++s) {
+            size_t start = (s + offset) % ptCount;
+            while (restCount[0][start]) {
+                walk.assign(1, start);
+                walkPos[start][walkPosCount[start]++] = 0;
+                while (walk.size() > 1 || restCount[0][start]) {
+                    size_t edge = walk.size() - 1;
+                    size_t v = takeEdge(edge % 2, walk.back());
+                    // The walk closes into an AB-cycle at an earlier visit
+                    // of v whose outgoing edge has the other type
+                    size_t closeAt = NONE;
+                    for (int k = 0; k < walkPosCount[v]; ++k) {
+                        if ((edge - walkPos[v][k]) % 2 == 1) {
+                            closeAt = walkPos[v][k];
+                        }
+                    }
+                    if (closeAt == NONE) {
+                        walkPos[v][walkPosCount[v]++] = walk.size();
+                        walk.push_back(v);
+                        continue;
+                    }
+                    std::vector<size_t> cycle(walk.begin() + closeAt,
+                                              walk.end());
+                    if (closeAt % 2 == 1) {
+                        std::rotate(cycle.begin(), cycle.begin() + 1,
+                                    cycle.end());
+                    }
+                    cycles.push_back(std::move(cycle));
+                    for (size_t i = closeAt + 1; i < walk.size(); ++i) {
+                        walkPosCount[walk[i]]--;
+                    }
+                    walk.resize(closeAt + 1);
+                }
+                walkPosCount[start] = 0;
+            }
+        }
+        return cycles;
+    }
+
+    // EAX with single AB-cycle E-sets: every child is the first parent with
+    // the A-edges of one AB-cycle replaced by its B-edges, subtours are then
+    // merged greedily by 2-exchanges over candidate lists. Returns the best
+    // child, or an empty solution if the parents are equal.
+    Solution EdgeAssemblyCrossover(const Solution& first,
+                                   const Solution& second,
+                                   std::mt19937& rng) const {
+        Links linkA = ComputeLinks(first.indices);
+        Links linkB = ComputeLinks(second.indices);
+        auto cycles = FindABCycles(linkA, linkB, rng);
+        std::shuffle(cycles.begin(), cycles.end(), rng);
+        if (cycles.size() > _params.childrenCount) {
+            cycles.resize(_params.childrenCount);
+        }
+        Solution best;
+        Links bestLinks;
+        bool found = false;
+        for (const auto& cycle : cycles) {
+            Links links = linkA;
+            Vector::CoordType distance = first.distance;
+            for (size_t i = 0; i < cycle.size(); i += 2) {
+                size_t u = cycle[i];
+                size_t v = cycle[i + 1];
+                ReplaceLink(links, u, v, NONE);
+                ReplaceLink(links, v, u, NONE);
+                distance -= Distance(u, v);
+            }
+            for (size_t i = 1; i < cycle.size(); i += 2) {
+                size_t u = cycle[i];
+                size_t v = cycle[(i + 1) % cycle.size()];
+                ReplaceLink(links, u, NONE, v);
+                ReplaceLink(links, v, NONE, u);
+                distance += Distance(u, v);
+            }
+            distance += MergeSubtours(links);
+            if (!found || distance < best.distance) {
+                found = true;
+                best.distance = distance;
+                bestLinks = std::move(links);
+            }
+        }
+        if (!found) {
+            return best;
+        }
+        best.indices = ComputeTour(bestLinks);
+        return best;
+    }
+
+    static std::vector<size_t> ComputeTour(const Links& links) {
+        std::vector<size_t> tour;
+        tour.reserve(links.size());
+        size_t previous = links[0][0];
+        size_t current = 0;
+        do {
+            tour.push_back(current);
+            size_t next =
+                (links[current][0] == previous ? links[current][1]
+                                               : links[current][0]);
+            previous = current;
+            current = next;
+        } while (current != 0);
+        return tour;
+    }
+
+    // Joins all cycles of `links` into one tour. The smallest subtour is
+    // repeatedly joined to a nearby one by the cheapest 2-exchange.
+    // Returns the change of the total length.
+    Vector::CoordType MergeSubtours(Links& links) const {
+        const size_t ptCount = links.size();
+        std::vector<size_t> label(ptCount, NONE);
+        std::vector<std::vector<size_t>> subtours;
+        for (size_t s = 0; s < ptCount; ++s) {
+            if (label[s] != NONE) {
+                continue;
+            }
+            subtours.emplace_back();
+            size_t previous = links[s][0];
+            size_t current = s;
+            do {
+                label[current] = subtours.size() - 1;
+                subtours.back().push_back(current);
+                size_t next =
+                    (links[current][0] == previous ? links[current][1]
+                                                   : links[current][0]);
+                previous = current;
+                current = next;
+            } while (current != s);
+        }
+
+        Vector::CoordType delta = 0;
+        std::vector<size_t> alive(subtours.size());
+        std::iota(alive.begin(), alive.end(), 0);
+        while (alive.size() > 1) {
+            auto smallestIt = std::min_element(
+                alive.begin(), alive.end(), [&](size_t s1, size_t s2) {
+                    return subtours[s1].size() < subtours[s2].size();
+                });
+            size_t smallest = *smallestIt;
+            Vector::CoordType bestCost = 0;
+            std::array<size_t, 4> bestMove = {NONE, NONE, NONE, NONE};
+            auto tryJoin = [&](size_t u, size_t w) {
+                for (size_t u1 : links[u]) {
+                    for (size_t w1 : links[w]) {
+                        Vector::CoordType cost = Distance(u, w) +
+                                                 Distance(u1, w1) -
+                                                 Distance(u, u1) -
+                                                 Distance(w, w1);
+                        if (bestMove[0] == NONE || cost < bestCost) {
+                            bestCost = cost;
+                            bestMove = {u, u1, w, w1};
+                        }
+                    }
+                }
+            };
+            for (size_t u : subtours[smallest]) {
+                for (size_t w : _neighbors[u]) {
+                    if (label[w] != smallest) {
+                        tryJoin(u, w);
+                    }
+                }
+            }
+            if (bestMove[0] == NONE) {
+                for (size_t u : subtours[smallest]) {
+                    for (size_t w = 0; w < ptCount; ++w) {
+                        if (label[w] != smallest) {
+                            tryJoin(u, w);
+                        }
+                    }
+                }
+            }
+            auto [u, u1, w, w1] = bestMove;
+            ReplaceLink(links, u, u1, w);
+            ReplaceLink(links, u1, u, w1);
+            ReplaceLink(links, w, w1, u);
+            ReplaceLink(links, w1, w, u1);
+            delta += bestCost;
+
+            size_t target = label[w];
+            for (size_t v : subtours[smallest]) {
+                label[v] = target;
+            }
+            subtours[target].insert(subtours[target].end(),
+                                    subtours[smallest].begin(),
+                                    subtours[smallest].end());
+            subtours[smallest].clear();
+            alive.erase(smallestIt);
+        }
+        return delta;
+    }
+
+    // OX: a random slice of the first parent is kept in place, the remaining
+    // cities follow in the order of the second parent. The child is then
+    // improved by 2-opt.
+    Solution OrderCrossover(const Solution& first,
+                            const Solution& second,
+                            std::mt19937& rng) const {
+        const size_t ptCount = first.indices.size();
+        std::uniform_int_distribution<size_t> unif_ind(0, ptCount - 1);
+        size_t from = unif_ind(rng);
+        size_t to = unif_ind(rng);
+        if (from > to) {
+            std::swap(from, to);
+        }
+        std::vector<char> taken(ptCount, false);
+        Solution child;
+        child.indices.reserve(ptCount);
+        for (size_t i = from; i <= to; ++i) {
+            child.indices.push_back(first.indices[i]);
+            taken[first.indices[i]] = true;
+        }
+        for (size_t i = 0; i < ptCount; ++i) {
+            size_t city = second.indices[(to + 1 + i) % ptCount];
+            if (!taken[city]) {
+                child.indices.push_back(city);
+            }
+        }
+        child.distance = ComputeTourDistance(child.indices);
+        child.distance -= _optimizer.Optimize(child.indices);
+        return child;
+    }
+};
@@ -0,0 +1,657 @@
+#pragma once
+
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../common/AnnealingSchedule.h"
+#include "Checkpoint.h"
+#include "GapMonitor.h"
+
+class Vector {
+   public:
+    using CoordType = long double;
+    Vector() : x(0), y(0) {}
+    Vector(CoordType x, CoordType y) : x(x), y(y) {}
+
+    friend std::istream& operator>>(std::istream& in, Vector& v) {
+        CoordType x, y;
+        in >> x >> y;
+        v = Vector(x, y);
+        return in;
+    }
+
+    CoordType GetX() const { return x; }
+    CoordType GetY() const { return y; }
+
+    CoordType Length() const { return std::sqrt(x * x + y * y); }
+
+    static CoordType ComputeDistance(const Vector& v1, const Vector& v2) {
+        return (v1 - v2).Length();
+    }
+
+    friend Vector operator-(const Vector& lhs, const Vector& rhs) {
+        return Vector(lhs.x - rhs.x, lhs.y - rhs.y);
+    }
+
+   private:
+    CoordType x, y;
+};
+
+class StopWatch {
+   public:
+    void Start() {
+        if (_started) {
+            throw std::runtime_error("Watch are already running");
+        }
+        _started = true;
+        _start = std::chrono::steady_clock::now();
+    }
+
+    void Reset() { _started = false; }
+
+    size_t GetDurationInMilliseconds() const {
+        auto end = std::chrono::steady_clock::now();
+        auto duration =
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - _start);
+        return duration.count();
+    }
+
+   private:
+    std::chrono::time_point<std::chrono::steady_clock> _start;
+    bool _started = false;
+};
+
+// Returns point indices sorted along a Hilbert curve over the bounding box.
+// Points close on the curve are close on the plane, so renumbering cities in
+// this order keeps neighbouring tour cities on neighbouring cache lines.
+inline std::vector<size_t> ComputeHilbertOrder(const std::vector<Vector>& pts) {
+    const uint32_t CURVE_SIDE = 1u << 16;
+    if (pts.empty()) {
+        return {};
+    }
+    Vector::CoordType minX = pts[0].GetX(), maxX = minX;
+    Vector::CoordType minY = pts[0].GetY(), maxY = minY;
+    for (const auto& p : pts) {
+        minX = std::min(minX, p.GetX());
+        maxX = std::max(maxX, p.GetX());
+        minY = std::min(minY, p.GetY());
+        maxY = std::max(maxY, p.GetY());
+    }
+    Vector::CoordType side = std::max({maxX - minX, maxY - minY,
+                                       (Vector::CoordType)1e-9});
+    std::vector<std::pair<uint64_t, size_t>> keys(pts.size());
+    for (size_t i = 0; i < pts.size(); ++i) {
+        uint32_t x = std::min<uint32_t>(
+            (pts[i].GetX() - minX) / side * (CURVE_SIDE - 1), CURVE_SIDE - 1);
+        uint32_t y = std::min<uint32_t>(
+            (pts[i].GetY() - minY) / side * (CURVE_SIDE - 1), CURVE_SIDE - 1);
+        uint64_t d = 0;
+        for (uint32_t s = CURVE_SIDE / 2; s > 0; s /= 2) {
+            uint32_t rx = (x & s) > 0;
+            uint32_t ry = (y & s) > 0;
+            d += (uint64_t)s * s * ((3 * rx) ^ ry);
+            if (!ry) {
+                if (rx) {
+                    x = CURVE_SIDE - 1 - x;
+                    y = CURVE_SIDE - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        keys[i] = {d, i};
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<size_t> order(pts.size());
+    for (size_t i = 0; i < pts.size(); ++i) {
+        order[i] = keys[i].second;
+    }
+    return order;
+}
+
+// Returns `k` nearest cities of every city, closest first. Cities are put into
+// a uniform grid and rings of cells around each city are scanned until no
+// unseen city can be closer than the k-th one found.
+inline std::vector<std::vector<size_t>> ComputeNearestNeighbors(
+    const std::vector<Vector>& pts,
+    size_t k) {
+    const size_t ptCount = pts.size();
+    std::vector<std::vector<size_t>> neighbors(ptCount);
+    k = std::min(k, ptCount ? ptCount - 1 : 0);
+    if (!k) {
+        return neighbors;
+    }
+    Vector::CoordType minX = pts[0].GetX(), maxX = minX;
+    Vector::CoordType minY = pts[0].GetY(), maxY = minY;
+    for (const auto& p : pts) {
+        minX = std::min(minX, p.GetX());
+        maxX = std::max(maxX, p.GetX());
+        minY = std::min(minY, p.GetY());
+        maxY = std::max(maxY, p.GetY());
+    }
+    const long gridSide =
+        std::max(1l, (long)std::sqrt(ptCount / 2.0));
+    const Vector::CoordType cellSize =
+        std::max({maxX - minX, maxY - minY, (Vector::CoordType)1e-9}) /
+        gridSide;
+    auto cellOf = [&](Vector::CoordType v, Vector::CoordType min) {
+        return std::min(gridSide - 1, (long)((v - min) / cellSize));
+    };
+
+    // Cities sorted by cell, cellStart[c] is the first city of cell c
+    std::vector<size_t> cellStart(gridSide * gridSide + 1, 0);
+    std::vector<size_t> cityCell(ptCount);
+    for (size_t i = 0; i < ptCount; ++i) {
+        cityCell[i] = cellOf(pts[i].GetY(), minY) * gridSide +
+                      cellOf(pts[i].GetX(), minX);
+        cellStart[cityCell[i] + 1]++;
+    }
+    for (size_t c = 0; c + 1 < cellStart.size(); ++c) {
+        cellStart[c + 1] += cellStart[c];
+    }
+    std::vector<size_t> cellCities(ptCount);
+    std::vector<size_t> filled(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < ptCount; ++i) {
+        cellCities[filled[cityCell[i]]++] = i;
+    }
+
+    std::vector<std::pair<Vector::CoordType, size_t>> found;
+    for (size_t i = 0; i < ptCount; ++i) {
+        found.clear();
+        long cx = cityCell[i] % gridSide;
+        long cy = cityCell[i] / gridSide;
+        for (long r = 0; r <= gridSide; ++r) {
+            for (long y = cy - r; y <= cy + r; ++y) {
+                if (y < 0 || y >= gridSide) {
+                    continue;
+                }
+                bool border = (y == cy - r || y == cy + r);
+                for (long x = cx - r; x <= cx + r;
+                     x += (border || r == 0 ? 1 : 2 * r)) {
+                    if (x < 0 || x >= gridSide) {
+                        continue;
+                    }
+                    size_t cell = y * gridSide + x;
+                    for (size_t j = cellStart[cell]; j < cellStart[cell + 1];
+                         ++j) {
+                        size_t city = cellCities[j];
+                        if (city != i) {
+                            found.push_back(
+                                {Vector::ComputeDistance(pts[i], pts[city]),
+                                 city});
+                        }
+                    }
+                }
+            }
+            if (found.size() >= k) {
+                std::nth_element(found.begin(), found.begin() + k - 1,
+                                 found.end());
+                if (found[k - 1].first <= r * cellSize) {
+                    break;
+                }
+            }
+        }
+        std::partial_sort(found.begin(), found.begin() + k, found.end());
+        for (size_t j = 0; j < k; ++j) {
+            neighbors[i].push_back(found[j].second);
+        }
+    }
+    return neighbors;
+}
+
+class LocalSearchSolver {
+   public:
+    struct Solution {
+        Vector::CoordType distance = 0;
+        bool isOptimal = false;
+        std::vector<size_t> indices;
+
+        friend std::ostream& operator<<(std::ostream& out,
+                                        const Solution& solution) {
+            out << std::fixed << solution.distance << ' ' << solution.isOptimal
+                << '\n';
+            for (auto i : solution.indices) {
+                out << i << ' ';
+            }
+            return out;
+        }
+    };
+
+    LocalSearchSolver(const std::vector<Vector>& pts) : _pts(pts) {}
+
+    // Best tours are reported to the monitor between rounds, and the search
+    // stops early once the monitor's target gap is reached
+    void SetGapMonitor(GapMonitor* monitor) { _monitor = monitor; }
+
+    // Annealing moves connect every city only to one of its candidate cities
+    // (e.g. alpha-nearest ones). Without candidates moves are uniform.
+    void SetCandidates(std::vector<std::vector<size_t>> candidates) {
+        _candidates = std::move(candidates);
+    }
+
+    using CheckpointHandler = std::function<void(const Checkpoint&)>;
+
+    // The handler receives the search state between rounds at most once per
+    // interval, and once more when the search ends
+    void SetCheckpointHandler(CheckpointHandler handler,
+                              size_t intervalInMilliseconds) {
+        _checkpointHandler = std::move(handler);
+        _checkpointIntervalInMilliseconds = intervalInMilliseconds;
+    }
+
+    // The search starts from the checkpoint tour instead of the greedy one.
+    // Annealing chains also continue with the saved random engines and
+    // temperatures.
+    void SetStart(Checkpoint checkpoint) { _start = std::move(checkpoint); }
+
+    // How annealing chains share progress between exchange rounds
+    enum class ExchangeMode {
+        // Every chain continues from the best tour found so far
+        BestTour,
+        // Parallel tempering: neighbouring chains swap their tours with
+        // the Metropolis probability for their temperatures
+        ReplicaSwap
+    };
+
+    struct AnnealingOptions {
+        size_t chainsCount = 1;
+        size_t exchangeIntervalInMilliseconds = 1000;
+        ExchangeMode exchangeMode = ExchangeMode::BestTour;
+        // Temperatures left at zero are derived from the instance
+        AnnealingSchedule::Params schedule = NoTemperatures();
+    };
+
+    Solution FindSolution(size_t maxTimeInSeconds = 60 * 10) const {
+        return FindSolution(maxTimeInSeconds, AnnealingOptions());
+    }
+
+    // Runs independent annealing chains, one per thread, and exchanges tours
+    // between them every exchange interval. Returns the best tour found.
+    Solution FindSolution(size_t maxTimeInSeconds,
+                          const AnnealingOptions& options) const {
+        Solution best = InitialSolution();
+        const size_t chainsCount = std::max<size_t>(1, options.chainsCount);
+        // Typical 2-opt deltas are of the order of an average tour edge
+        const double AVERAGE_EDGE = best.distance / _pts.size();
+        AnnealingSchedule::Params schedule = options.schedule;
+        if (schedule.initTemp <= 0) {
+            schedule.initTemp = AVERAGE_EDGE;
+        }
+        if (schedule.finalTemp <= 0) {
+            schedule.finalTemp = AVERAGE_EDGE * 1e-3;
+        }
+        std::vector<AnnealingChain> chains(chainsCount);
+        for (size_t c = 0; c < chainsCount; ++c) {
+            chains[c].current = best;
+            chains[c].re.seed(c + 1);
+            // Replicas cover a ladder of temperatures, independent restarts
+            // only get slightly different ones
+            auto params = schedule;
+            double scale = (options.exchangeMode == ExchangeMode::ReplicaSwap
+                                ? std::pow(2.0, c)
+                                : 1 + 0.1 * c);
+            params.initTemp *= scale;
+            params.finalTemp *= scale;
+            chains[c].schedule = AnnealingSchedule(params);
+            chains[c].budget = SearchBudget(maxTimeInSeconds);
+            if (_start && c < _start->chains.size()) {
+                Checkpoint::LoadRandomState(_start->chains[c].randomState,
+                                            chains[c].re);
+                chains[c].schedule.Resume(_start->chains[c].schedule);
+            }
+        }
+        size_t lastCheckpoint = 0;
+        StopWatch watch;
+        watch.Start();
+        std::default_random_engine re;
+        std::uniform_real_distribution<long double> unif_prob(0, 1);
+        size_t elapsed = 0;
+        while (elapsed < 1000 * maxTimeInSeconds) {
+            size_t roundEnd =
+                elapsed + options.exchangeIntervalInMilliseconds;
+            if (chainsCount == 1) {
+                RunChain(chains[0], roundEnd);
+            } else {
+                std::vector<std::thread> threads;
+                for (auto& chain : chains) {
+                    threads.emplace_back(&LocalSearchSolver::RunChain, this,
+                                         std::ref(chain), roundEnd);
+                }
+                for (auto& t : threads) {
+                    t.join();
+                }
+            }
+
+            const Solution* roundBest = &best;
+            for (const auto& chain : chains) {
+                if (chain.best.distance < roundBest->distance) {
+                    roundBest = &chain.best;
+                }
+            }
+            if (roundBest != &best) {
+                best = *roundBest;
+                std::cerr << "New distance found: " << std::fixed
+                          << best.distance << '\r';
+            }
+            if (IsGapReached(best)) {
+                break;
+            }
+
+            if (chainsCount > 1 &&
+                options.exchangeMode == ExchangeMode::BestTour) {
+                for (auto& chain : chains) {
+                    chain.current = best;
+                }
+            } else if (chainsCount > 1) {
+                for (size_t c = 0; c + 1 < chainsCount; ++c) {
+                    auto& cold = chains[c];
+                    auto& hot = chains[c + 1];
+                    long double exponent =
+                        (1 / cold.schedule.GetTemperature() -
+                         1 / hot.schedule.GetTemperature()) *
+                        (cold.current.distance - hot.current.distance);
+                    if (exponent >= 0 || unif_prob(re) < std::exp(exponent)) {
+                        std::swap(cold.current, hot.current);
+                    }
+                }
+            }
+            elapsed = watch.GetDurationInMilliseconds();
+            if (IsCheckpointDue(elapsed, lastCheckpoint)) {
+                SaveCheckpoint(best, chains);
+            }
+        }
+        SaveCheckpoint(best, chains);
+        return best;
+    }
+
+    // Splits the tour into one segment per thread and improves the segments
+    // concurrently. Segment end cities stay fixed during a round, so threads
+    // never touch each other's cities; boundaries are shifted between rounds.
+    Solution FindSolutionParallel(size_t maxTimeInSeconds,
+                                  size_t threadsCount) const {
+        Solution current = InitialSolution();
+        Solution best = current;
+        const size_t ptCount = _pts.size();
+        threadsCount = std::max<size_t>(1, std::min(threadsCount, ptCount / 8));
+        const size_t ROUND_TIME_IN_MILLISECONDS = 2000;
+        StopWatch watch;
+        watch.Start();
+        std::default_random_engine re;
+        std::uniform_int_distribution<size_t> unif_ind(0, ptCount - 1);
+        size_t elapsed = 0;
+        size_t lastCheckpoint = 0;
+        while (elapsed < 1000 * maxTimeInSeconds) {
+            std::rotate(current.indices.begin(),
+                        current.indices.begin() + unif_ind(re),
+                        current.indices.end());
+            size_t roundTime = std::min(ROUND_TIME_IN_MILLISECONDS,
+                                        1000 * maxTimeInSeconds - elapsed);
+            size_t segmentLength = ptCount / threadsCount;
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < threadsCount; ++t) {
+                size_t begin = t * segmentLength;
+                size_t end =
+                    (t + 1 == threadsCount ? ptCount : begin + segmentLength);
+                threads.emplace_back(&LocalSearchSolver::OptimizeSegment, this,
+                                     std::ref(current), begin, end, roundTime,
+                                     re());
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            current.distance = ComputeTourDistance(current.indices);
+            if (current.distance < best.distance) {
+                best = current;
+                std::cerr << "New distance found: " << std::fixed
+                          << best.distance << '\r';
+            }
+            if (IsGapReached(best)) {
+                break;
+            }
+            elapsed = watch.GetDurationInMilliseconds();
+            if (IsCheckpointDue(elapsed, lastCheckpoint)) {
+                SaveCheckpoint(best, {});
+            }
+        }
+        SaveCheckpoint(best, {});
+        return best;
+    }
+
+   private:
+    struct AnnealingChain {
+        Solution current;
+        Solution best;
+        std::default_random_engine re;
+        AnnealingSchedule schedule;
+        SearchBudget budget{0};
+        // Tour position of every city, kept only for candidate moves
+        std::vector<size_t> position;
+    };
+
+    const Vector::CoordType EPS = 1e-6;
+
+    static AnnealingSchedule::Params NoTemperatures() {
+        AnnealingSchedule::Params params;
+        params.initTemp = params.finalTemp = 0;
+        return params;
+    }
+
+    std::vector<Vector> _pts;
+    GapMonitor* _monitor = nullptr;
+    std::vector<std::vector<size_t>> _candidates;
+    CheckpointHandler _checkpointHandler;
+    size_t _checkpointIntervalInMilliseconds = 0;
+    std::optional<Checkpoint> _start;
+
+    Solution InitialSolution() const {
+        Solution s;
+        if (_start) {
+            s.indices = _start->tour;
+            s.distance = ComputeTourDistance(s.indices);
+            std::cerr << "Search resumed. Distance: " << std::fixed
+                      << s.distance << std::endl;
+        } else {
+            s = GreedySolution();
+            std::cerr << "Greedy solution found. Distance: " << std::fixed
+                      << s.distance << std::endl;
+        }
+        return s;
+    }
+
+    bool IsCheckpointDue(size_t elapsed, size_t& lastCheckpoint) const {
+        if (!_checkpointHandler ||
+            elapsed < lastCheckpoint + _checkpointIntervalInMilliseconds) {
+            return false;
+        }
+        lastCheckpoint = elapsed;
+        return true;
+    }
+
+    void SaveCheckpoint(const Solution& best,
+                        const std::vector<AnnealingChain>& chains) const {
+        if (!_checkpointHandler) {
+            return;
+        }
+        Checkpoint checkpoint;
+        checkpoint.distance = best.distance;
+        checkpoint.tour = best.indices;
+        for (const auto& chain : chains) {
+            checkpoint.chains.push_back(
+                {Checkpoint::SaveRandomState(chain.re),
+                 chain.schedule.GetState()});
+        }
+        _checkpointHandler(checkpoint);
+    }
+
+    Solution GreedySolution() const {
+        Solution s;
+        s.indices.push_back(0);
+        size_t ptCount = _pts.size();
+        std::vector<bool> used(ptCount, false);
+        used[0] = true;
+        while (s.indices.size() != ptCount) {
+            size_t last = s.indices.back();
+            size_t next = last;
+            for (size_t i = 0; i < ptCount; ++i) {
+                if (!used[i] &&
+                    (next == last ||
+                     ComputeDistance(next, last) > ComputeDistance(i, last))) {
+                    next = i;
+                }
+            }
+            s.indices.push_back(next);
+            used[next] = true;
+        }
+        s.distance = ComputeTourDistance(s.indices);
+        return s;
+    }
+
+    Vector::CoordType ComputeTourDistance(
+        const std::vector<size_t>& indices) const {
+        Vector::CoordType length = 0;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            length +=
+                ComputeDistance(indices[i], indices[(i + 1) % _pts.size()]);
+        }
+        return length;
+    }
+
+    Vector::CoordType ComputeDistance(size_t p1, size_t p2) const {
+        return Vector::ComputeDistance(_pts[p1 % _pts.size()],
+                                       _pts[p2 % _pts.size()]);
+    }
+
+    bool IsGapReached(const Solution& best) const {
+        if (!_monitor) {
+            return false;
+        }
+        _monitor->ReportTour(best.distance);
+        return _monitor->IsGapReached();
+    }
+
+    Vector::CoordType ComputeDifferenceAfterSwap(const Solution& solution,
+                                                 size_t e1,
+                                                 size_t e2) const {
+        size_t B = solution.indices[(e1 + _pts.size() - 1) % _pts.size()];
+        size_t C = solution.indices[e1];
+        size_t F = solution.indices[(e2 + _pts.size() + 1) % _pts.size()];
+        size_t E = solution.indices[e2];
+        Vector::CoordType length =
+            ComputeDistance(B, C) + ComputeDistance(E, F);
+        length -= ComputeDistance(B, E) + ComputeDistance(C, F);
+        return length;
+    }
+
+    // Anneals the chain until its budget reports `roundEndInMilliseconds`
+    void RunChain(AnnealingChain& chain, size_t roundEndInMilliseconds) const {
+        std::uniform_int_distribution<size_t> unif_ind(0, _pts.size() - 1);
+        if (chain.best.indices.empty()) {
+            chain.best = chain.current;
+        }
+        const bool useCandidates = !_candidates.empty();
+        if (useCandidates) {
+            chain.position.resize(_pts.size());
+            for (size_t i = 0; i < _pts.size(); ++i) {
+                chain.position[chain.current.indices[i]] = i;
+            }
+        }
+        auto& budget = chain.budget;
+        while (budget.Tick() &&
+               budget.GetElapsedMilliseconds() < roundEndInMilliseconds) {
+            chain.schedule.Update(budget.GetProgress());
+            size_t e1, e2;
+            if (useCandidates) {
+                PickCandidateMove(chain, e1, e2);
+            } else {
+                e1 = unif_ind(chain.re);
+                e2 = unif_ind(chain.re);
+                if (e1 > e2) {
+                    std::swap(e1, e2);
+                }
+            }
+            if (e1 >= e2 || (!e1 && e2 + 1 == _pts.size())) {
+                continue;
+            }
+            Vector::CoordType diff =
+                ComputeDifferenceAfterSwap(chain.current, e1, e2);
+            if (chain.schedule.Accept(-diff, chain.re)) {
+                std::reverse(chain.current.indices.begin() + e1,
+                             chain.current.indices.begin() + e2 + 1);
+                if (useCandidates) {
+                    for (size_t i = e1; i <= e2; ++i) {
+                        chain.position[chain.current.indices[i]] = i;
+                    }
+                }
+                chain.current.distance -= diff;
+                if (chain.current.distance < chain.best.distance) {
+                    chain.best = chain.current;
+                    chain.schedule.NotifyImprovement();
+                }
+            }
+        }
+    }
+
+    // Chooses a 2-opt move reversing positions [e1, e2] which connects a
+    // random city to one of its candidates. Returns e1 >= e2 for no move.
+    void PickCandidateMove(AnnealingChain& chain, size_t& e1, size_t& e2) const {
+        const auto& tour = chain.current.indices;
+        std::uniform_int_distribution<size_t> unif_pos(1, _pts.size() - 1);
+        size_t pos = unif_pos(chain.re);
+        const auto& candidates = _candidates[tour[pos - 1]];
+        e1 = e2 = 0;
+        if (candidates.empty()) {
+            return;
+        }
+        std::uniform_int_distribution<size_t> unif_cand(0,
+                                                        candidates.size() - 1);
+        size_t target = chain.position[candidates[unif_cand(chain.re)]];
+        if (target > pos) {
+            // tour[pos - 1] is followed by the candidate after the reversal
+            e1 = pos;
+            e2 = target;
+        } else if (target + 1 < pos) {
+            // the candidate is followed by tour[pos - 1] after the reversal
+            e1 = target + 1;
+            e2 = pos - 1;
+        }
+    }
+
+    // Improves tour positions [begin, end) by 2-opt moves which keep the
+    // cities at both ends of the segment in place
+    void OptimizeSegment(Solution& solution,
+                         size_t begin,
+                         size_t end,
+                         size_t maxTimeInMilliseconds,
+                         unsigned seed) const {
+        if (end - begin < 4) {
+            return;
+        }
+        SearchBudget budget(maxTimeInMilliseconds / 1000.0);
+        std::default_random_engine re(seed);
+        std::uniform_int_distribution<size_t> unif_ind(begin + 1, end - 2);
+        while (budget.Tick()) {
+            size_t e1 = unif_ind(re);
+            size_t e2 = unif_ind(re);
+            if (e1 > e2) {
+                std::swap(e1, e2);
+            }
+            if (e1 == e2) {
+                continue;
+            }
+            if (ComputeDifferenceAfterSwap(solution, e1, e2) > EPS) {
+                std::reverse(solution.indices.begin() + e1,
+                             solution.indices.begin() + e2 + 1);
+            }
+        }
+    }
+};
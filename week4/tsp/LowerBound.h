@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "../../common/AnnealingSchedule.h"
+#include "GapMonitor.h"
+#include "LocalSearchSolver.h"
+
+// Held-Karp lower bound: the minimum 1-tree under node penalties pi, with
+// the penalties optimized by subgradient ascent. City 0 is the special node
+// of the 1-tree; the spanning tree on the other cities is built by dense
+// Prim in O(n^2) time and O(n) memory per iteration.
+class HeldKarpBound {
+   public:
+    explicit HeldKarpBound(const std::vector<Vector>& pts)
+        : _pts(pts),
+          _x(pts.size()),
+          _y(pts.size()),
+          _pi(pts.size(), 0),
+          _bestPi(pts.size(), 0),
+          _lastDirection(pts.size(), 0) {
+        for (size_t i = 0; i < pts.size(); ++i) {
+            _x[i] = pts[i].GetX();
+            _y[i] = pts[i].GetY();
+        }
+    }
+
+    // Continues the ascent from the penalties reached by the previous call
+    // until the time is over, the step vanishes or the monitor is stopped.
+    // Every improvement of the bound is reported to the monitor.
+    void Ascent(GapMonitor& monitor, double maxTimeInSeconds) {
+        const size_t ptCount = _pts.size();
+        if (ptCount < 3 || _converged) {
+            return;
+        }
+        // Iterations without improvement before the step is halved
+        const size_t PERIOD = std::max<size_t>(ptCount / 2, 100);
+        SearchBudget budget(maxTimeInSeconds, std::numeric_limits<size_t>::max(),
+                            1);
+        while (budget.Tick() && !monitor.IsStopped()) {
+            OneTree tree = ComputeOneTree(_pi);
+            double bound = tree.length;
+            double norm = 0;
+            for (size_t i = 0; i < ptCount; ++i) {
+                bound -= 2 * _pi[i];
+                norm += (tree.degree[i] - 2) * (tree.degree[i] - 2);
+            }
+            if (bound > _bestBound) {
+                _bestBound = bound;
+                _bestPi = _pi;
+                _sinceImprovement = 0;
+                monitor.ReportBound(bound);
+            } else if (++_sinceImprovement >= PERIOD) {
+                _step /= 2;
+                _sinceImprovement = 0;
+            }
+            if (norm == 0) {
+                // The 1-tree is a tour, so the bound is the optimum
+                _converged = true;
+                break;
+            }
+            if (_step < 1e-6) {
+                _converged = true;
+                break;
+            }
+            double upperBound = monitor.GetUpperBound();
+            if (!std::isfinite(upperBound) || upperBound <= bound) {
+                upperBound = bound * 1.01 + 1e-9;
+            }
+            double t = _step * (upperBound - bound) / norm;
+            for (size_t i = 0; i < ptCount; ++i) {
+                double direction = tree.degree[i] - 2;
+                _pi[i] += t * (0.7 * direction + 0.3 * _lastDirection[i]);
+                _lastDirection[i] = direction;
+            }
+        }
+    }
+
+    double GetBound() const { return _bestBound; }
+
+    // For every city returns `k` cities with the smallest alpha-nearness
+    // under the best penalties found, ties broken by penalized cost. Only the
+    // `nearestCount` geometrically nearest cities are examined.
+    // alpha(i, j) is the increase of the minimum 1-tree length when it is
+    // forced to contain edge (i, j).
+    std::vector<std::vector<size_t>> ComputeAlphaCandidates(
+        size_t k,
+        size_t nearestCount) const {
+        const size_t ptCount = _pts.size();
+        auto nearest = ComputeNearestNeighbors(_pts, std::max(k, nearestCount));
+        if (ptCount < 3) {
+            return nearest;
+        }
+        OneTree tree = ComputeOneTree(_bestPi);
+
+        // Binary lifting over the spanning tree on cities 1..n-1: up[l][v] is
+        // the 2^l-th ancestor, top[l][v] the longest edge on the way there
+        size_t levels = 1;
+        while ((1ul << levels) < ptCount) {
+            levels++;
+        }
+        std::vector<std::vector<size_t>> up(levels,
+                                            std::vector<size_t>(ptCount));
+        std::vector<std::vector<double>> top(levels,
+                                             std::vector<double>(ptCount, 0));
+        std::vector<size_t> depth(ptCount, 0);
+        for (size_t v : tree.order) {
+            bool root = (tree.parent[v] == NONE);
+            up[0][v] = (root ? v : tree.parent[v]);
+            top[0][v] = (root ? 0 : Cost(v, tree.parent[v], _bestPi));
+            depth[v] = (root ? 0 : depth[tree.parent[v]] + 1);
+        }
+        for (size_t l = 1; l < levels; ++l) {
+            for (size_t v : tree.order) {
+                up[l][v] = up[l - 1][up[l - 1][v]];
+                top[l][v] = std::max(top[l - 1][v], top[l - 1][up[l - 1][v]]);
+            }
+        }
+        auto longestOnPath = [&](size_t u, size_t v) {
+            double longest = 0;
+            if (depth[u] < depth[v]) {
+                std::swap(u, v);
+            }
+            for (size_t l = levels; l-- > 0;) {
+                if (depth[u] - depth[v] >= (1ul << l)) {
+                    longest = std::max(longest, top[l][u]);
+                    u = up[l][u];
+                }
+            }
+            if (u == v) {
+                return longest;
+            }
+            for (size_t l = levels; l-- > 0;) {
+                if (up[l][u] != up[l][v]) {
+                    longest = std::max({longest, top[l][u], top[l][v]});
+                    u = up[l][u];
+                    v = up[l][v];
+                }
+            }
+            return std::max({longest, top[0][u], top[0][v]});
+        };
+
+        std::vector<std::vector<size_t>> candidates(ptCount);
+        std::vector<std::pair<std::pair<double, double>, size_t>> scored;
+        for (size_t i = 0; i < ptCount; ++i) {
+            scored.clear();
+            for (size_t j : nearest[i]) {
+                double cost = Cost(i, j, _bestPi);
+                double alpha;
+                if (i == 0 || j == 0) {
+                    // Edge to the special node replaces its longer edge
+                    size_t other = (i == 0 ? j : i);
+                    bool inTree = (other == tree.special[0] ||
+                                   other == tree.special[1]);
+                    alpha = (inTree ? 0 : cost - tree.specialCost[1]);
+                } else {
+                    alpha = cost - longestOnPath(i, j);
+                }
+                scored.push_back({{std::max(0.0, alpha), cost}, j});
+            }
+            size_t count = std::min(k, scored.size());
+            std::partial_sort(scored.begin(), scored.begin() + count,
+                              scored.end());
+            for (size_t c = 0; c < count; ++c) {
+                candidates[i].push_back(scored[c].second);
+            }
+        }
+        return candidates;
+    }
+
+   private:
+    constexpr static size_t NONE = std::numeric_limits<size_t>::max();
+
+    struct OneTree {
+        double length = 0;
+        std::vector<int> degree;
+        // Spanning tree on cities 1..n-1, parents precede children in order
+        std::vector<size_t> parent;
+        std::vector<size_t> order;
+        // The two cheapest edges of the special city 0
+        size_t special[2] = {NONE, NONE};
+        double specialCost[2] = {0, 0};
+    };
+
+    const std::vector<Vector>& _pts;
+    std::vector<double> _x, _y;
+    std::vector<double> _pi, _bestPi, _lastDirection;
+    double _bestBound = -std::numeric_limits<double>::infinity();
+    double _step = 1;
+    size_t _sinceImprovement = 0;
+    bool _converged = false;
+
+    double Cost(size_t i, size_t j, const std::vector<double>& pi) const {
+        double dx = _x[i] - _x[j];
+        double dy = _y[i] - _y[j];
+        return std::sqrt(dx * dx + dy * dy) + pi[i] + pi[j];
+    }
+
+    OneTree ComputeOneTree(const std::vector<double>& pi) const {
+        const size_t ptCount = _pts.size();
+        OneTree tree;
+        tree.degree.assign(ptCount, 0);
+        tree.parent.assign(ptCount, NONE);
+        tree.order.reserve(ptCount - 1);
+
+        std::vector<double> key(ptCount,
+                                std::numeric_limits<double>::infinity());
+        std::vector<char> inTree(ptCount, false);
+        size_t next = 1;
+        key[1] = 0;
+        for (size_t added = 0; added + 1 < ptCount; ++added) {
+            size_t v = next;
+            inTree[v] = true;
+            tree.order.push_back(v);
+            if (tree.parent[v] != NONE) {
+                tree.length += key[v];
+                tree.degree[v]++;
+                tree.degree[tree.parent[v]]++;
+            }
+            next = NONE;
+            for (size_t u = 1; u < ptCount; ++u) {
+                if (inTree[u]) {
+                    continue;
+                }
+                double cost = Cost(v, u, pi);
+                if (cost < key[u]) {
+                    key[u] = cost;
+                    tree.parent[u] = v;
+                }
+                if (next == NONE || key[u] < key[next]) {
+                    next = u;
+                }
+            }
+        }
+
+        for (size_t u = 1; u < ptCount; ++u) {
+            double cost = Cost(0, u, pi);
+            if (tree.special[0] == NONE || cost < tree.specialCost[0]) {
+                tree.special[1] = tree.special[0];
+                tree.specialCost[1] = tree.specialCost[0];
+                tree.special[0] = u;
+                tree.specialCost[0] = cost;
+            } else if (tree.special[1] == NONE || cost < tree.specialCost[1]) {
+                tree.special[1] = u;
+                tree.specialCost[1] = cost;
+            }
+        }
+        for (size_t s = 0; s < 2; ++s) {
+            tree.length += tree.specialCost[s];
+            tree.degree[0]++;
+            tree.degree[tree.special[s]]++;
+        }
+        return tree;
+    }
+};
@@ -1,213 +1,250 @@
-#include <pthread.h>
-#include <algorithm>
-#include <chrono>
-#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <optional>
-#include <random>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
-class Vector {
-   public:
-    using CoordType = long double;
-    Vector() : x(0), y(0) {}
-    Vector(CoordType x, CoordType y) : x(x), y(y) {}
+#include "GeneticSolver.h"
+#include "LocalSearchSolver.h"
+#include "LowerBound.h"
+
+enum class Engine { Annealing, Segments, Genetic };
+
+struct Options {
+    std::string filename;
+    Engine engine = Engine::Annealing;
+    bool hilbertOrder = false;
+    size_t maxTimeInSeconds = 60 * 10;
+    size_t threadsCount = 1;
+    LocalSearchSolver::AnnealingOptions annealing;
+    GeneticSolver::Params genetic;
+    // Held-Karp lower bound is computed alongside the search
+    bool lowerBound = false;
+    // The search stops once the tour is within this relative gap
+    double targetGap = 0;
+    bool alphaCandidates = false;
+    // Binary checkpoint which is rewritten every checkpoint interval
+    std::string checkpointFilename;
+    size_t checkpointIntervalInSeconds = 60;
+    // Checkpoint or answer file to continue from
+    std::string resumeFilename;
+};
 
-    friend std::istream& operator>>(std::istream& in, Vector& v) {
-        CoordType x, y;
-        in >> x >> y;
-        v = Vector(x, y);
-        return in;
+Options ParseOptions(int argc, char* argv[]) {
+    const std::string usage =
+        "Usage: ./" + std::string(argv[0]) +
+        " <filename> [--engine annealing|segments|genetic] [--hilbert]"
+        " [--time <seconds>] [--threads <count>]"
+        " [--chains <count>] [--exchange <milliseconds>] [--tempering]"
+        " [--schedule geometric|linear|hyperbolic|adaptive]"
+        " [--init-temp <temp>] [--final-temp <temp>] [--reheat <moves>]"
+        " [--population <size>] [--crossover eax|ox]"
+        " [--bound] [--gap <fraction>] [--candidates alpha]"
+        " [--checkpoint <file>] [--checkpoint-interval <seconds>]"
+        " [--resume <checkpoint or answer file>]";
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "annealing") {
+                options.engine = Engine::Annealing;
+            } else if (engine == "segments") {
+                options.engine = Engine::Segments;
+            } else if (engine == "genetic") {
+                options.engine = Engine::Genetic;
+            } else {
+                throw std::runtime_error(usage);
+            }
+        } else if (arg == "--hilbert") {
+            options.hilbertOrder = true;
+        } else if (arg == "--time" && i + 1 < argc) {
+            options.maxTimeInSeconds = std::stoul(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threadsCount = std::max(1ul, std::stoul(argv[++i]));
+            options.genetic.threadsCount = options.threadsCount;
+        } else if (arg == "--chains" && i + 1 < argc) {
+            options.annealing.chainsCount = std::stoul(argv[++i]);
+        } else if (arg == "--exchange" && i + 1 < argc) {
+            options.annealing.exchangeIntervalInMilliseconds =
+                std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--tempering") {
+            options.annealing.exchangeMode =
+                LocalSearchSolver::ExchangeMode::ReplicaSwap;
+        } else if (arg == "--schedule" && i + 1 < argc) {
+            options.annealing.schedule.kind =
+                AnnealingSchedule::ParseKind(argv[++i]);
+        } else if (arg == "--init-temp" && i + 1 < argc) {
+            options.annealing.schedule.initTemp = std::stod(argv[++i]);
+        } else if (arg == "--final-temp" && i + 1 < argc) {
+            options.annealing.schedule.finalTemp = std::stod(argv[++i]);
+        } else if (arg == "--reheat" && i + 1 < argc) {
+            options.annealing.schedule.reheatAfter = std::stoul(argv[++i]);
+        } else if (arg == "--population" && i + 1 < argc) {
+            options.genetic.populationSize = std::stoul(argv[++i]);
+        } else if (arg == "--crossover" && i + 1 < argc) {
+            std::string crossover = argv[++i];
+            if (crossover != "eax" && crossover != "ox") {
+                throw std::runtime_error(usage);
+            }
+            options.genetic.crossover =
+                (crossover == "eax" ? GeneticSolver::Crossover::EdgeAssembly
+                                    : GeneticSolver::Crossover::Order);
+        } else if (arg == "--bound") {
+            options.lowerBound = true;
+        } else if (arg == "--gap" && i + 1 < argc) {
+            options.targetGap = std::stod(argv[++i]);
+            options.lowerBound = true;
+        } else if (arg == "--candidates" && i + 1 < argc) {
+            if (std::string(argv[++i]) != "alpha") {
+                throw std::runtime_error(usage);
+            }
+            options.alphaCandidates = true;
+            options.lowerBound = true;
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpointFilename = argv[++i];
+        } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            options.checkpointIntervalInSeconds = std::stoul(argv[++i]);
+        } else if (arg == "--resume" && i + 1 < argc) {
+            options.resumeFilename = argv[++i];
+        } else if (options.filename.empty() && arg.rfind("--", 0) != 0) {
+            options.filename = arg;
+        } else {
+            throw std::runtime_error(usage);
+        }
     }
-
-    CoordType Length() const { return std::sqrt(x * x + y * y); }
-
-    static CoordType ComputeDistance(const Vector& v1, const Vector& v2) {
-        return (v1 - v2).Length();
+    if (options.filename.empty()) {
+        throw std::runtime_error(usage);
     }
+    return options;
+}
 
-    friend Vector operator-(const Vector& lhs, const Vector& rhs) {
-        return Vector(lhs.x - rhs.x, lhs.y - rhs.y);
+void solve(std::istream& in, std::ostream& out, const Options& options) {
+    size_t ptCount;
+    in >> ptCount;
+    std::vector<Vector> pts(ptCount);
+    for (auto& p : pts) {
+        in >> p;
     }
 
-   private:
-    CoordType x, y;
-};
-
-class StopWatch {
-   public:
-    void Start() {
-        if (_started) {
-            throw std::runtime_error("Watch are already running");
+    // Engines work on renumbered cities, input numbering is restored on output
+    std::vector<size_t> inputIndex(ptCount);
+    for (size_t i = 0; i < ptCount; ++i) {
+        inputIndex[i] = i;
+    }
+    if (options.hilbertOrder) {
+        inputIndex = ComputeHilbertOrder(pts);
+        std::vector<Vector> ordered(ptCount);
+        for (size_t i = 0; i < ptCount; ++i) {
+            ordered[i] = pts[inputIndex[i]];
         }
-        _started = true;
-        _start = std::chrono::system_clock::now();
+        pts.swap(ordered);
     }
 
-    void Reset() { _started = false; }
-
-    size_t GetDurationInMilliseconds() const {
-        auto end = std::chrono::system_clock::now();
-        auto duration =
-            std::chrono::duration_cast<std::chrono::milliseconds>(end - _start);
-        return duration.count();
+    // Checkpoints are kept in input numbering, so they do not depend on
+    // --hilbert
+    std::vector<size_t> engineIndex(ptCount);
+    for (size_t i = 0; i < ptCount; ++i) {
+        engineIndex[inputIndex[i]] = i;
     }
-
-   private:
-    std::chrono::time_point<std::chrono::system_clock> _start;
-    bool _started = false;
-};
-
-class LocalSearchSolver {
-   public:
-    struct Solution {
-        Vector::CoordType distance = 0;
-        bool isOptimal = false;
-        std::vector<size_t> indices;
-
-        friend std::ostream& operator<<(std::ostream& out,
-                                        const Solution& solution) {
-            out << std::fixed << solution.distance << ' ' << solution.isOptimal
-                << '\n';
-            for (auto i : solution.indices) {
-                out << i << ' ';
-            }
-            return out;
+    std::optional<Checkpoint> start;
+    if (!options.resumeFilename.empty()) {
+        start = Checkpoint::Load(options.resumeFilename);
+        const std::string error =
+            options.resumeFilename + " is not a tour of " + options.filename;
+        if (start->tour.size() != ptCount) {
+            throw std::runtime_error(error);
         }
-    };
-
-    LocalSearchSolver(const std::vector<Vector>& pts) : _pts(pts) {}
-
-    Solution FindSolution(size_t maxTimeInSeconds = 60 * 10) const {
-        Solution current = GreedySolution();
-        Solution best = current;
-        std::cerr << "Greedy solution found. Distance: " << std::fixed
-                  << current.distance << std::endl;
-        StopWatch watch;
-        watch.Start();
-        bool running = true;
-        std::uniform_real_distribution<long double> unif_prob(0, 1);
-        std::uniform_int_distribution<size_t> unif_ind(0, _pts.size() - 1);
-        std::default_random_engine re;
-        const long double INIT_TEMP = _pts.size() * 500;
-        long double temp = INIT_TEMP;
-        long double alpha = 0.994;
-        size_t it = 0;
-        while (running) {
-            size_t e1 = unif_ind(re);
-            size_t e2 = unif_ind(re);
-            if (e1 > e2) {
-                std::swap(e1, e2);
-            }
-            if (e1 == e2 || (!e1 && e2 + 1 == _pts.size())) {
-                continue;
-            }
-            Vector::CoordType diff =
-                ComputeDifferenceAfterSwap(current, e1, e2);
-            long double prob = std::exp(diff / temp);
-            if (diff > 0 || unif_prob(re) < prob) {
-                current = MakeSwap(current, e1, e2);
-                current.distance -= diff;
-                if (current.distance < best.distance) {
-                    best = current;
-                    std::cerr << "New distance found: " << std::fixed
-                              << best.distance << '\r';
-                }
-                it++;
-                temp = INIT_TEMP * alpha / it;
+        std::vector<bool> visited(ptCount, false);
+        for (auto& i : start->tour) {
+            if (i >= ptCount || visited[i]) {
+                throw std::runtime_error(error);
             }
-            size_t duration = watch.GetDurationInMilliseconds();
-            running = (duration < 1000 * maxTimeInSeconds);
+            visited[i] = true;
+            i = engineIndex[i];
         }
-        return current;
     }
-
-   private:
-    const Vector::CoordType EPS = 1e-6;
-
-    std::vector<Vector> _pts;
-
-    Solution GreedySolution() const {
-        Solution s;
-        s.indices.push_back(0);
-        size_t ptCount = _pts.size();
-        std::vector<bool> used(ptCount, false);
-        used[0] = true;
-        while (s.indices.size() != ptCount) {
-            size_t last = s.indices.back();
-            size_t next = last;
-            for (size_t i = 0; i < ptCount; ++i) {
-                if (!used[i] &&
-                    (next == last ||
-                     ComputeDistance(next, last) > ComputeDistance(i, last))) {
-                    next = i;
-                }
+    LocalSearchSolver::CheckpointHandler checkpointHandler;
+    if (!options.checkpointFilename.empty()) {
+        checkpointHandler = [&](const Checkpoint& checkpoint) {
+            Checkpoint saved = checkpoint;
+            for (auto& i : saved.tour) {
+                i = inputIndex[i];
             }
-            s.indices.push_back(next);
-            used[next] = true;
-        }
-        s.distance = ComputeTourDistance(s.indices);
-        return s;
-    }
-
-    Vector::CoordType ComputeTourDistance(
-        const std::vector<size_t>& indices) const {
-        Vector::CoordType length = 0;
-        for (size_t i = 0; i < indices.size(); ++i) {
-            length +=
-                ComputeDistance(indices[i], indices[(i + 1) % _pts.size()]);
-        }
-        return length;
+            saved.Save(options.checkpointFilename);
+        };
     }
-
-    Vector::CoordType ComputeDistance(size_t p1, size_t p2) const {
-        return Vector::ComputeDistance(_pts[p1 % _pts.size()],
-                                       _pts[p2 % _pts.size()]);
+    const size_t checkpointInterval =
+        1000 * options.checkpointIntervalInSeconds;
+
+    GapMonitor monitor(options.targetGap);
+    GapMonitor* monitorPtr = (options.lowerBound ? &monitor : nullptr);
+    HeldKarpBound bound(pts);
+    std::vector<std::vector<size_t>> candidates;
+    size_t searchTime = options.maxTimeInSeconds;
+    if (options.alphaCandidates) {
+        // A short ascent is enough for alpha values to order the candidates
+        size_t ascentTime = std::min<size_t>(
+            searchTime, std::max<size_t>(1, searchTime / 20));
+        bound.Ascent(monitor, ascentTime);
+        searchTime -= ascentTime;
+        candidates = bound.ComputeAlphaCandidates(5, 15);
+        std::cerr << "Alpha candidates computed. Lower bound: " << std::fixed
+                  << monitor.GetLowerBound() << std::endl;
     }
-
-    Vector::CoordType ComputeDifferenceAfterSwap(const Solution& solution,
-                                                 size_t e1,
-                                                 size_t e2) const {
-        size_t B = solution.indices[(e1 + _pts.size() - 1) % _pts.size()];
-        size_t C = solution.indices[e1];
-        size_t F = solution.indices[(e2 + _pts.size() + 1) % _pts.size()];
-        size_t E = solution.indices[e2];
-        Vector::CoordType length =
-            ComputeDistance(B, C) + ComputeDistance(E, F);
-        length -= ComputeDistance(B, E) + ComputeDistance(C, F);
-        return length;
+    std::thread boundThread;
+    if (options.lowerBound) {
+        boundThread = std::thread([&] { bound.Ascent(monitor, searchTime); });
     }
 
-    Solution MakeSwap(const Solution& solution, size_t e1, size_t e2) const {
-        if (e1 > e2) {
-            std::swap(e1, e2);
+    LocalSearchSolver::Solution solution;
+    if (options.engine == Engine::Genetic) {
+        GeneticSolver solver(pts, options.genetic);
+        solver.SetGapMonitor(monitorPtr);
+        if (options.alphaCandidates) {
+            solver.SetCandidates(candidates);
         }
-        Solution newSolution = solution;
-        std::reverse(newSolution.indices.begin() + e1,
-                     newSolution.indices.begin() + e2 + 1);
-        return newSolution;
+        solver.SetCheckpointHandler(checkpointHandler, checkpointInterval);
+        if (start) {
+            solver.SetStart(*start);
+        }
+        solution = solver.FindSolution(searchTime);
+    } else {
+        LocalSearchSolver solver(pts);
+        solver.SetGapMonitor(monitorPtr);
+        if (options.alphaCandidates) {
+            solver.SetCandidates(candidates);
+        }
+        solver.SetCheckpointHandler(checkpointHandler, checkpointInterval);
+        if (start) {
+            solver.SetStart(*start);
+        }
+        solution = (options.engine == Engine::Segments
+                        ? solver.FindSolutionParallel(searchTime,
+                                                      options.threadsCount)
+                        : solver.FindSolution(searchTime, options.annealing));
     }
-};
 
-void solve(std::istream& in, std::ostream& out) {
-    size_t ptCount;
-    in >> ptCount;
-    std::vector<Vector> pts(ptCount);
-    for (auto& p : pts) {
-        in >> p;
+    if (options.lowerBound) {
+        monitor.Stop();
+        boundThread.join();
+        monitor.ReportTour(solution.distance);
+        std::cerr << std::endl
+                  << "Lower bound: " << std::fixed << monitor.GetLowerBound()
+                  << ", gap: " << monitor.GetGap() * 100 << "%" << std::endl;
+        solution.isOptimal = monitor.IsOptimal();
     }
-    LocalSearchSolver solver(pts);
-    out << solver.FindSolution();
+    for (auto& i : solution.indices) {
+        i = inputIndex[i];
+    }
+    out << solution;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        throw std::runtime_error("Usage: ./" + std::string(argv[0]) +
-                                 " <filename>");
-    }
-    std::ifstream fin(argv[1]);
-    solve(fin, std::cout);
+    Options options = ParseOptions(argc, argv);
+    std::ifstream fin(options.filename);
+    solve(fin, std::cout, options);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
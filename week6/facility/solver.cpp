@@ -0,0 +1,647 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../common/AnnealingSchedule.h"
+
+// Uniform grid over the facilities for k-nearest queries. Cells hold about
+// two facilities each; a query scans rings of cells around the point until
+// no unseen cell can contain a closer facility.
+class FacilityGrid {
+public:
+  FacilityGrid(const std::vector<double> &xs, const std::vector<double> &ys)
+      : _xs(xs), _ys(ys) {
+    const size_t n = xs.size();
+    _minX = *std::min_element(xs.begin(), xs.end());
+    _minY = *std::min_element(ys.begin(), ys.end());
+    double width = *std::max_element(xs.begin(), xs.end()) - _minX;
+    double height = *std::max_element(ys.begin(), ys.end()) - _minY;
+    _cellSize = std::max(std::sqrt(2 * width * height / n), 1e-9);
+    if (width * height == 0) {
+      _cellSize = std::max({width, height, 1e-9}) / std::max<size_t>(1, n / 2);
+    }
+    _columns = std::min<size_t>(width / _cellSize + 1, n + 1);
+    _rows = std::min<size_t>(height / _cellSize + 1, n + 1);
+    // Facilities of every cell are contiguous in _items
+    _cellStart.assign(_columns * _rows + 1, 0);
+    for (size_t f = 0; f < n; ++f) {
+      _cellStart[CellOf(xs[f], ys[f]) + 1]++;
+    }
+    std::partial_sum(_cellStart.begin(), _cellStart.end(), _cellStart.begin());
+    _items.resize(n);
+    auto next = _cellStart;
+    for (size_t f = 0; f < n; ++f) {
+      _items[next[CellOf(xs[f], ys[f])]++] = f;
+    }
+  }
+
+  // Facilities sorted by distance to the point
+  std::vector<int> FindNearest(double x, double y, size_t k) const {
+    k = std::min(k, _items.size());
+    int column = Clamp((x - _minX) / _cellSize, _columns);
+    int row = Clamp((y - _minY) / _cellSize, _rows);
+    std::vector<std::pair<double, int>> found;
+    for (int ring = 0;; ++ring) {
+      for (int r = row - ring; r <= row + ring; ++r) {
+        for (int c = column - ring; c <= column + ring; ++c) {
+          bool onRing = (std::abs(r - row) == ring || std::abs(c - column) == ring);
+          if (!onRing || r < 0 || c < 0 || r >= int(_rows) ||
+              c >= int(_columns)) {
+            continue;
+          }
+          size_t cell = r * _columns + c;
+          for (size_t i = _cellStart[cell]; i < _cellStart[cell + 1]; ++i) {
+            int f = _items[i];
+            found.push_back({std::hypot(_xs[f] - x, _ys[f] - y), f});
+          }
+        }
+      }
+      bool isCovered = (ring >= int(std::max(_rows, _columns)));
+      if (found.size() >= k) {
+        std::nth_element(found.begin(), found.begin() + k - 1, found.end());
+        // Cells beyond the ring are at least ring * cellSize away
+        isCovered |= (found[k - 1].first <= ring * _cellSize);
+      }
+      if (isCovered) {
+        break;
+      }
+    }
+    std::partial_sort(found.begin(), found.begin() + k, found.end());
+    std::vector<int> nearest(k);
+    for (size_t i = 0; i < k; ++i) {
+      nearest[i] = found[i].second;
+    }
+    return nearest;
+  }
+
+private:
+  const std::vector<double> &_xs, &_ys;
+  double _minX, _minY, _cellSize;
+  size_t _columns, _rows;
+  std::vector<size_t> _cellStart;
+  std::vector<int> _items;
+
+  static int Clamp(double index, size_t count) {
+    return std::min<int>(std::max(0.0, index), count - 1);
+  }
+
+  size_t CellOf(double x, double y) const {
+    return Clamp((y - _minY) / _cellSize, _rows) * _columns +
+           Clamp((x - _minX) / _cellSize, _columns);
+  }
+};
+
+// Capacitated facility location: every customer is served by one facility,
+// the demands served by a facility fit into its capacity. Setup costs of the
+// used facilities plus distances from customers to their facilities are
+// minimized.
+class Solver {
+public:
+  void ParseFrom(std::istream &in) {
+    size_t facilitiesCount, customersCount;
+    in >> facilitiesCount >> customersCount;
+    setupCosts.resize(facilitiesCount);
+    capacities.resize(facilitiesCount);
+    facilityX.resize(facilitiesCount);
+    facilityY.resize(facilitiesCount);
+    for (size_t f = 0; f < facilitiesCount; ++f) {
+      in >> setupCosts[f] >> capacities[f] >> facilityX[f] >> facilityY[f];
+    }
+    demands.resize(customersCount);
+    customerX.resize(customersCount);
+    customerY.resize(customersCount);
+    for (size_t c = 0; c < customersCount; ++c) {
+      in >> demands[c] >> customerX[c] >> customerY[c];
+    }
+    if (!in) {
+      throw std::runtime_error("Failed to read the instance");
+    }
+    BuildNearestLists();
+  }
+
+  struct Solution {
+    std::vector<int> assignment;
+    // Cached demands served by every facility and numbers of their
+    // customers; a facility is open if it has customers
+    std::vector<int64_t> loads;
+    std::vector<int> counts;
+    // Customers of every facility and positions of the customers there
+    std::vector<std::vector<int>> members;
+    std::vector<int> memberIndex;
+    // Open facilities and their positions there
+    std::vector<int> openFacilities;
+    std::vector<int> openIndex;
+    // Nearest and second nearest open facilities of every customer, -1 if
+    // there are none
+    std::vector<int> firstOpen, secondOpen;
+    // Customers which have less than two open facilities in their nearest
+    // lists, so any opened or closed facility may change theirs. The list
+    // may keep customers which are not far any more; isFar marks the
+    // customers in the list
+    std::vector<int> farCustomers;
+    std::vector<bool> isFar;
+    double value = 0;
+    bool isOptimal = false;
+
+    friend std::ostream &operator<<(std::ostream &out,
+                                    const Solution &solution) {
+      out << std::fixed << std::setprecision(3) << solution.value << ' '
+          << solution.isOptimal << '\n';
+      for (int f : solution.assignment) {
+        out << f << ' ';
+      }
+      out << '\n';
+      return out;
+    }
+  };
+
+  // Greedy construction improved by simulated annealing over reassign,
+  // open, close and swap moves. Moves are drawn from the nearest lists, so
+  // every evaluation touches only the customers around the facilities
+  Solution FindSolution(double maxTimeInSeconds, unsigned seed) {
+    auto solution = GreedySolution();
+    std::cerr << "Initial value: " << solution.value << '\n';
+    std::mt19937 mt(seed);
+    plannedLoads.assign(setupCosts.size(), 0);
+    plannedCounts.assign(setupCosts.size(), 0);
+
+    // Temperatures are relative to an average cost per customer
+    double averageCost = solution.value / demands.size();
+    AnnealingSchedule::Params params;
+    params.initTemp = 0.5 * averageCost;
+    params.finalTemp = 1e-4 * averageCost;
+    AnnealingSchedule schedule(params);
+    // Copying the whole solution on every improvement is too slow
+    auto bestAssignment = solution.assignment;
+    double bestValue = solution.value;
+
+    SearchBudget budget(maxTimeInSeconds);
+    std::vector<Reassignment> plan;
+    std::uniform_int_distribution<int> rdCustomer(0, demands.size() - 1);
+    std::uniform_int_distribution<int> rdFacility(0, setupCosts.size() - 1);
+    std::uniform_int_distribution<int> rdNearest(0, nearestCount - 1);
+    std::uniform_int_distribution<int> rdMove(0, 99);
+    while (budget.Tick()) {
+      schedule.Update(budget.GetProgress());
+      plan.clear();
+      int move = rdMove(mt);
+      int c = rdCustomer(mt);
+      // Facility of a random customer is an open one
+      int open = solution.assignment[c];
+      int near = nearest[c * nearestCount + rdNearest(mt)];
+      if (move < 85) {
+        // Reassign a customer to one of its nearest facilities, mostly to
+        // the nearest open one
+        int f = near;
+        if (move < 40) {
+          f = solution.firstOpen[c];
+          if (f == open) {
+            f = solution.secondOpen[c];
+          }
+        } else if (move < 50) {
+          f = solution.assignment[rdCustomer(mt)];
+        }
+        if (f >= 0 && f != open) {
+          plan.push_back({c, f});
+        }
+      } else if (move < 92) {
+        PlanClose(solution, open, plan);
+      } else if (move < 97) {
+        int f = (move < 95 ? near : rdFacility(mt));
+        if (!solution.counts[f]) {
+          PlanOpen(solution, f, plan);
+        }
+      } else if (!solution.counts[near]) {
+        PlanSwap(solution, open, near, plan);
+      }
+      if (plan.empty()) {
+        continue;
+      }
+      auto delta = Evaluate(solution, plan);
+      if (delta && schedule.Accept(*delta, mt)) {
+        Apply(solution, plan, *delta);
+        if (solution.value < bestValue - EPS) {
+          bestAssignment = solution.assignment;
+          bestValue = solution.value;
+          schedule.NotifyImprovement();
+          std::cerr << "New value found: " << bestValue << '\r';
+        }
+      }
+    }
+    std::cerr << "\nEvaluated moves: " << budget.GetIterations() << '\n';
+    // Accumulated rounding errors of the deltas
+    solution.assignment = std::move(bestAssignment);
+    RefreshStats(solution);
+    return solution;
+  }
+
+private:
+  const double EPS = 1e-9;
+  const size_t NEAREST_COUNT = 24;
+  // Close moves scan the open facilities for customers whose nearest lists
+  // are full only while there are few of them: with many open facilities
+  // the scans take most of the time and rarely lead to accepted moves
+  const size_t MAX_SCANNED_OPEN = 100;
+
+  // Facilities
+  std::vector<double> setupCosts;
+  std::vector<int64_t> capacities;
+  std::vector<double> facilityX, facilityY;
+  // Customers
+  std::vector<int64_t> demands;
+  std::vector<double> customerX, customerY;
+
+  // Nearest facilities of every customer by increasing distance, row by
+  // row, and customers which have a facility in their nearest lists
+  size_t nearestCount = 0;
+  std::vector<int> nearest;
+  std::vector<std::vector<int>> nearbyCustomers;
+
+  // Scratch arrays of Evaluate, zero between calls
+  std::vector<int64_t> plannedLoads;
+  std::vector<int> plannedCounts;
+  std::vector<int> touched;
+
+  struct Reassignment {
+    int customer;
+    int facility;
+  };
+
+  double Distance(int f, int c) const {
+    double dx = facilityX[f] - customerX[c];
+    double dy = facilityY[f] - customerY[c];
+    return std::sqrt(dx * dx + dy * dy);
+  }
+
+  void BuildNearestLists() {
+    const size_t n = setupCosts.size(), m = demands.size();
+    nearestCount = std::min(NEAREST_COUNT, n);
+    nearest.resize(m * nearestCount);
+    nearbyCustomers.assign(n, {});
+    FacilityGrid grid(facilityX, facilityY);
+    for (size_t c = 0; c < m; ++c) {
+      auto list = grid.FindNearest(customerX[c], customerY[c], nearestCount);
+      std::copy(list.begin(), list.end(), nearest.begin() + c * nearestCount);
+      for (int f : list) {
+        nearbyCustomers[f].push_back(c);
+      }
+    }
+  }
+
+  bool HasRoom(const Solution &solution, int f, int64_t demand) const {
+    return solution.loads[f] + plannedLoads[f] + demand <= capacities[f];
+  }
+
+  // Customers by decreasing demand, each one to the facility with the
+  // smallest distance plus setup cost if the facility is not open yet.
+  // Only the nearest list is scanned unless none of it has enough room
+  Solution GreedySolution() {
+    const size_t n = setupCosts.size(), m = demands.size();
+    Solution solution;
+    solution.assignment.assign(m, -1);
+    solution.loads.assign(n, 0);
+    solution.counts.assign(n, 0);
+    plannedLoads.assign(n, 0);
+    std::vector<int> customers(m);
+    std::iota(customers.begin(), customers.end(), 0);
+    std::stable_sort(customers.begin(), customers.end(),
+                     [this](int c1, int c2) {
+                       return demands[c1] > demands[c2];
+                     });
+    for (int c : customers) {
+      int chosen = -1;
+      double chosenCost = 0;
+      auto consider = [&](int f) {
+        if (!HasRoom(solution, f, demands[c])) {
+          return;
+        }
+        double cost = Distance(f, c) + (solution.counts[f] ? 0 : setupCosts[f]);
+        if (chosen < 0 || cost < chosenCost) {
+          chosen = f;
+          chosenCost = cost;
+        }
+      };
+      for (size_t i = 0; i < nearestCount; ++i) {
+        consider(nearest[c * nearestCount + i]);
+      }
+      for (size_t f = 0; chosen < 0 && f < n; ++f) {
+        consider(f);
+      }
+      if (chosen < 0) {
+        throw std::runtime_error("Demands do not fit into the facilities");
+      }
+      solution.assignment[c] = chosen;
+      solution.loads[chosen] += demands[c];
+      solution.counts[chosen]++;
+    }
+    RefreshStats(solution);
+    return solution;
+  }
+
+  // Recomputes cached loads, counts, members, nearest open facilities and
+  // the value from the assignment
+  void RefreshStats(Solution &solution) const {
+    const size_t n = setupCosts.size(), m = demands.size();
+    solution.loads.assign(n, 0);
+    solution.counts.assign(n, 0);
+    solution.members.assign(n, {});
+    solution.memberIndex.assign(m, 0);
+    solution.openFacilities.clear();
+    solution.openIndex.assign(n, -1);
+    solution.firstOpen.assign(m, -1);
+    solution.secondOpen.assign(m, -1);
+    solution.farCustomers.clear();
+    solution.isFar.assign(m, false);
+    solution.value = 0;
+    for (size_t c = 0; c < m; ++c) {
+      int f = solution.assignment[c];
+      solution.loads[f] += demands[c];
+      solution.counts[f]++;
+      solution.memberIndex[c] = solution.members[f].size();
+      solution.members[f].push_back(c);
+      solution.value += Distance(f, c);
+    }
+    for (size_t f = 0; f < n; ++f) {
+      if (solution.counts[f]) {
+        solution.value += setupCosts[f];
+        solution.openIndex[f] = solution.openFacilities.size();
+        solution.openFacilities.push_back(f);
+      }
+    }
+    for (size_t c = 0; c < m; ++c) {
+      UpdateNearestOpen(solution, c);
+    }
+  }
+
+  // Open facilities outside of the nearest list are farther than all of
+  // it, so the list is completed by a scan of the open facilities
+  void UpdateNearestOpen(Solution &solution, int c) const {
+    int *open[] = {&solution.firstOpen[c], &solution.secondOpen[c]};
+    *open[0] = *open[1] = -1;
+    size_t found = 0;
+    for (size_t i = 0; i < nearestCount && found < 2; ++i) {
+      int f = nearest[c * nearestCount + i];
+      if (solution.counts[f]) {
+        *open[found++] = f;
+      }
+    }
+    if (found == 2) {
+      return;
+    }
+    if (!solution.isFar[c]) {
+      solution.isFar[c] = true;
+      solution.farCustomers.push_back(c);
+    }
+    for (; found < 2; ++found) {
+      for (int f : solution.openFacilities) {
+        if (f == *open[0]) {
+          continue;
+        }
+        if (*open[found] < 0 || Distance(f, c) < Distance(*open[found], c)) {
+          *open[found] = f;
+        }
+      }
+    }
+  }
+
+  // Nearest open facility except `excluded` with enough residual capacity
+  // for the customer, -1 if there is none. The open facilities are scanned
+  // only if the nearest list has no such facility and they are few
+  int FindTarget(const Solution &solution, int c, int excluded) const {
+    for (int f : {solution.firstOpen[c], solution.secondOpen[c]}) {
+      if (f >= 0 && f != excluded && HasRoom(solution, f, demands[c])) {
+        return f;
+      }
+    }
+    for (size_t i = 0; i < nearestCount; ++i) {
+      int f = nearest[c * nearestCount + i];
+      if (f != excluded && solution.counts[f] &&
+          HasRoom(solution, f, demands[c])) {
+        return f;
+      }
+    }
+    int chosen = -1;
+    if (solution.openFacilities.size() > MAX_SCANNED_OPEN) {
+      return chosen;
+    }
+    for (int f : solution.openFacilities) {
+      if (f == excluded || !HasRoom(solution, f, demands[c])) {
+        continue;
+      }
+      if (chosen < 0 || Distance(f, c) < Distance(chosen, c)) {
+        chosen = f;
+      }
+    }
+    return chosen;
+  }
+
+  // Moves the customers of an open facility, by decreasing demand, to the
+  // nearest other open facilities with enough residual capacity
+  void PlanClose(const Solution &solution, int closed,
+                 std::vector<Reassignment> &plan) {
+    std::vector<int> customers = solution.members[closed];
+    std::sort(customers.begin(), customers.end(), [this](int c1, int c2) {
+      return demands[c1] > demands[c2];
+    });
+    for (int c : customers) {
+      int chosen = FindTarget(solution, c, closed);
+      if (chosen < 0) {
+        break;
+      }
+      Reserve(chosen, demands[c]);
+      plan.push_back({c, chosen});
+    }
+    ResetScratch();
+    if (plan.size() != customers.size()) {
+      // Evaluate would reject a plan which keeps the facility open
+      plan.clear();
+    }
+  }
+
+  // Opens a closed facility and moves to it the customers which get closer,
+  // by decreasing gain while the capacity allows. Only the customers which
+  // have the facility in their nearest lists are considered
+  void PlanOpen(const Solution &solution, int opened,
+                std::vector<Reassignment> &plan) const {
+    std::vector<std::pair<double, int>> gains;
+    for (int c : nearbyCustomers[opened]) {
+      double gain = Distance(solution.assignment[c], c) - Distance(opened, c);
+      if (gain > 0) {
+        gains.push_back({gain, c});
+      }
+    }
+    std::sort(gains.rbegin(), gains.rend());
+    int64_t load = 0;
+    for (auto [gain, c] : gains) {
+      if (load + demands[c] <= capacities[opened]) {
+        load += demands[c];
+        plan.push_back({c, opened});
+      }
+    }
+  }
+
+  // Moves all customers of an open facility to a closed one
+  void PlanSwap(const Solution &solution, int closed, int opened,
+                std::vector<Reassignment> &plan) const {
+    if (solution.loads[closed] > capacities[opened]) {
+      return;
+    }
+    for (int c : solution.members[closed]) {
+      plan.push_back({c, opened});
+    }
+  }
+
+  void Reserve(int f, int64_t demand) {
+    if (!plannedLoads[f] && !plannedCounts[f]) {
+      touched.push_back(f);
+    }
+    plannedLoads[f] += demand;
+    plannedCounts[f]++;
+  }
+
+  void Release(int f, int64_t demand) {
+    if (!plannedLoads[f] && !plannedCounts[f]) {
+      touched.push_back(f);
+    }
+    plannedLoads[f] -= demand;
+    plannedCounts[f]--;
+  }
+
+  void ResetScratch() {
+    for (int f : touched) {
+      plannedLoads[f] = 0;
+      plannedCounts[f] = 0;
+    }
+    touched.clear();
+  }
+
+  // Change of the value after the reassignments, nothing if a capacity is
+  // exceeded
+  std::optional<double> Evaluate(const Solution &solution,
+                                 const std::vector<Reassignment> &plan) {
+    double delta = 0;
+    for (auto [c, to] : plan) {
+      int from = solution.assignment[c];
+      delta += Distance(to, c) - Distance(from, c);
+      Release(from, demands[c]);
+      Reserve(to, demands[c]);
+    }
+    bool isFeasible = true;
+    for (int f : touched) {
+      if (solution.loads[f] + plannedLoads[f] > capacities[f]) {
+        isFeasible = false;
+      }
+      bool wasOpen = solution.counts[f] > 0;
+      bool isOpen = solution.counts[f] + plannedCounts[f] > 0;
+      delta += setupCosts[f] * (int(isOpen) - int(wasOpen));
+    }
+    ResetScratch();
+    if (!isFeasible) {
+      return std::nullopt;
+    }
+    return delta;
+  }
+
+  void Apply(Solution &solution, const std::vector<Reassignment> &plan,
+             double delta) {
+    for (auto [c, to] : plan) {
+      int from = solution.assignment[c];
+      solution.loads[from] -= demands[c];
+      solution.loads[to] += demands[c];
+      // Facilities which get opened or closed
+      if (!--solution.counts[from]) {
+        touched.push_back(from);
+      }
+      if (!solution.counts[to]++) {
+        touched.push_back(to);
+      }
+      auto &fromMembers = solution.members[from];
+      int last = fromMembers.back();
+      fromMembers[solution.memberIndex[c]] = last;
+      solution.memberIndex[last] = solution.memberIndex[c];
+      fromMembers.pop_back();
+      solution.memberIndex[c] = solution.members[to].size();
+      solution.members[to].push_back(c);
+      solution.assignment[c] = to;
+    }
+    if (touched.empty()) {
+      solution.value += delta;
+      return;
+    }
+    for (int f : touched) {
+      if (solution.counts[f] && solution.openIndex[f] < 0) {
+        solution.openIndex[f] = solution.openFacilities.size();
+        solution.openFacilities.push_back(f);
+      } else if (!solution.counts[f] && solution.openIndex[f] >= 0) {
+        int last = solution.openFacilities.back();
+        solution.openFacilities[solution.openIndex[f]] = last;
+        solution.openIndex[last] = solution.openIndex[f];
+        solution.openFacilities.pop_back();
+        solution.openIndex[f] = -1;
+      }
+    }
+    auto farCustomers = std::move(solution.farCustomers);
+    solution.farCustomers.clear();
+    for (int c : farCustomers) {
+      if (solution.isFar[c]) {
+        solution.isFar[c] = false;
+        UpdateNearestOpen(solution, c);
+      }
+    }
+    for (int f : touched) {
+      for (int c : nearbyCustomers[f]) {
+        UpdateNearestOpen(solution, c);
+      }
+    }
+    touched.clear();
+    solution.value += delta;
+  }
+};
+
+struct Options {
+  std::string filename;
+  double maxTimeInSeconds = 30;
+  unsigned seed = 1;
+};
+
+Options ParseOptions(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--time" && i + 1 < argc) {
+      options.maxTimeInSeconds = std::stod(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      options.seed = std::stoul(argv[++i]);
+    } else {
+      options.filename = arg;
+    }
+  }
+  if (options.filename.empty()) {
+    throw std::runtime_error("Usage: " + std::string(argv[0]) +
+                             " [--time <seconds>] [--seed <seed>] filename");
+  }
+  return options;
+}
+
+void solve(std::istream &in, std::ostream &out, const Options &options) {
+  Solver solver;
+  solver.ParseFrom(in);
+  out << solver.FindSolution(options.maxTimeInSeconds, options.seed);
+}
+
+int main(int argc, char *argv[]) {
+  Options options = ParseOptions(argc, argv);
+  std::ifstream fin(options.filename);
+  solve(fin, std::cout, options);
+  return EXIT_SUCCESS;
+}
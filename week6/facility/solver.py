@@ -1,13 +1,29 @@
 #!/usr/bin/python
 # -*- coding: utf-8 -*-
 
+import os
 import sys
+from subprocess import Popen, PIPE
+
+
+def run_cpp_solution(input_data):
+    # Writes the inputData to a temporay file
+    tmp_file_name = 'tmp.data'
+    tmp_file = open(tmp_file_name, 'w')
+    tmp_file.write(input_data)
+    tmp_file.close()
+
+    bin_path = './solver.out'
+    process = Popen([bin_path, tmp_file_name],
+                    stdout=PIPE, universal_newlines=True)
+    (stdout, stderr) = process.communicate()
+    # removes the temporay file
+    os.remove(tmp_file_name)
+    return stdout.strip()
 
 
 def solve_it(input_data: str) -> str:
-    answer_file = './answers/' + '_'.join(input_data.split('\n')[0].split())
-    with open(answer_file, 'r') as f:
-        return f.read()
+    return run_cpp_solution(input_data)
 
 
 if __name__ == '__main__':
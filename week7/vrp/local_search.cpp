@@ -1,16 +1,30 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
+#include <optional>
 #include <random>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-#include "TSPSolver.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "../../common/AnnealingSchedule.h"
 
 struct Point {
   double x;
@@ -30,12 +44,301 @@ double length(const Point &p1, const Point &p2) {
 
 struct Warehouse {
   size_t index;
+  size_t inputIndex;
   int demand;
   Point location;
 };
 
+// Position of the point on a Hilbert curve covering [minX, minX + side]^2
+uint64_t ComputeHilbertKey(const Point &p, double minX, double minY,
+                           double side) {
+  const uint32_t CURVE_SIDE = 1u << 16;
+  uint32_t x = std::min<uint32_t>((p.x - minX) / side * (CURVE_SIDE - 1),
+                                  CURVE_SIDE - 1);
+  uint32_t y = std::min<uint32_t>((p.y - minY) / side * (CURVE_SIDE - 1),
+                                  CURVE_SIDE - 1);
+  uint64_t d = 0;
+  for (uint32_t s = CURVE_SIDE / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    d += (uint64_t)s * s * ((3 * rx) ^ ry);
+    if (!ry) {
+      if (rx) {
+        x = CURVE_SIDE - 1 - x;
+        y = CURVE_SIDE - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+// Distances between all warehouses in a contiguous row-major float matrix,
+// so a distance lookup is a single load. Distances from the depot and polar
+// angles around it are kept in separate arrays for construction.
+// Must be rebuilt when warehouses are renumbered.
+class DistanceMatrix {
+public:
+  void Build(const std::vector<Warehouse> &warehouses) {
+    _size = warehouses.size();
+    _distances.resize(_size * _size);
+    _angles.resize(_size);
+    for (size_t i = 0; i < _size; ++i) {
+      _distances[i * _size + i] = 0;
+      for (size_t j = i + 1; j < _size; ++j) {
+        float distance = length(warehouses[i].location, warehouses[j].location);
+        _distances[i * _size + j] = _distances[j * _size + i] = distance;
+      }
+    }
+    _depotDistances.assign(_distances.begin(), _distances.begin() + _size);
+    if (_size) {
+      const Point &depot = warehouses[0].location;
+      for (size_t i = 0; i < _size; ++i) {
+        _angles[i] = std::atan2(warehouses[i].location.y - depot.y,
+                                warehouses[i].location.x - depot.x);
+      }
+    }
+  }
+
+  float operator()(int w1, int w2) const {
+    return _distances[w1 * _size + w2];
+  }
+
+  float FromDepot(int w) const { return _depotDistances[w]; }
+
+  // Polar angle in (-pi, pi] around the depot
+  float GetAngle(int w) const { return _angles[w]; }
+
+private:
+  size_t _size = 0;
+  std::vector<float> _distances;
+  std::vector<float> _depotDistances;
+  std::vector<float> _angles;
+};
+
+// Optimizes the order of customers inside one route. Routes of up to
+// EXACT_LIMIT customers are solved exactly by Held-Karp DP, longer ones by
+// 2-opt and Or-opt with O(1) move evaluation. Results are cached by the set
+// of customers, so a route which is seen again costs one hash lookup.
+// A route is [0, c1, ..., ck, 0].
+class RouteOptimizer {
+public:
+  using Route = std::vector<int>;
+
+  explicit RouteOptimizer(const DistanceMatrix &distances)
+      : _distances(distances) {}
+
+  // Reorders the customers of the route, returns its length
+  double Optimize(Route &route) {
+    if (route.size() <= 4) {
+      return ComputeLength(route);
+    }
+    Route key(route.begin() + 1, route.end() - 1);
+    std::sort(key.begin(), key.end());
+    auto it = _cache.find(key);
+    if (it != _cache.end()) {
+      route = it->second.route;
+      return it->second.length;
+    }
+    if (route.size() - 2 <= EXACT_LIMIT) {
+      SolveExactly(route);
+    } else {
+      ImproveLocally(route);
+    }
+    double length = ComputeLength(route);
+    if (_cache.size() >= MAX_CACHE_SIZE) {
+      _cache.clear();
+    }
+    _cache.emplace(std::move(key), CacheEntry{route, length});
+    return length;
+  }
+
+  // Must be called when warehouses are renumbered
+  void Clear() { _cache.clear(); }
+
+private:
+  const size_t EXACT_LIMIT = 10;
+  const size_t MAX_CACHE_SIZE = 1 << 18;
+  const double EPS = 1e-9;
+
+  struct CacheEntry {
+    Route route;
+    double length;
+  };
+
+  struct RouteHash {
+    size_t operator()(const Route &customers) const {
+      uint64_t hash = 1469598103934665603ull;
+      for (int c : customers) {
+        hash = (hash ^ (uint64_t)c) * 1099511628211ull;
+      }
+      return hash;
+    }
+  };
+
+  const DistanceMatrix &_distances;
+  std::unordered_map<Route, CacheEntry, RouteHash> _cache;
+
+  double Distance(int w1, int w2) const { return _distances(w1, w2); }
+
+  double ComputeLength(const Route &route) const {
+    double distance = 0;
+    for (size_t i = 1; i < route.size(); ++i) {
+      distance += Distance(route[i - 1], route[i]);
+    }
+    return distance;
+  }
+
+  // Held-Karp DP over subsets of the k customers: O(2^k k^2)
+  void SolveExactly(Route &route) const {
+    const size_t k = route.size() - 2;
+    std::vector<int> customers(route.begin() + 1, route.end() - 1);
+    const size_t full = (size_t(1) << k) - 1;
+    std::vector<double> dp((full + 1) * k,
+                           std::numeric_limits<double>::infinity());
+    std::vector<uint8_t> from((full + 1) * k, 0);
+    for (size_t last = 0; last < k; ++last) {
+      dp[(size_t(1) << last) * k + last] = Distance(0, customers[last]);
+    }
+    for (size_t mask = 1; mask <= full; ++mask) {
+      for (size_t last = 0; last < k; ++last) {
+        double current = dp[mask * k + last];
+        if (!(mask >> last & 1) || std::isinf(current)) {
+          continue;
+        }
+        for (size_t next = 0; next < k; ++next) {
+          if (mask >> next & 1) {
+            continue;
+          }
+          size_t nextMask = mask | (size_t(1) << next);
+          double candidate =
+              current + Distance(customers[last], customers[next]);
+          if (candidate < dp[nextMask * k + next]) {
+            dp[nextMask * k + next] = candidate;
+            from[nextMask * k + next] = last;
+          }
+        }
+      }
+    }
+    size_t last = 0;
+    for (size_t c = 1; c < k; ++c) {
+      if (dp[full * k + c] + Distance(customers[c], 0) <
+          dp[full * k + last] + Distance(customers[last], 0)) {
+        last = c;
+      }
+    }
+    size_t mask = full;
+    for (size_t pos = k; pos > 0; --pos) {
+      route[pos] = customers[last];
+      size_t prev = from[mask * k + last];
+      mask ^= size_t(1) << last;
+      last = prev;
+    }
+  }
+
+  // First-improvement 2-opt and Or-opt (segments of 1-3 customers, both
+  // orientations) until no improving move is left
+  void ImproveLocally(Route &route) const {
+    bool improved = true;
+    while (improved) {
+      improved = TwoOpt(route) || OrOpt(route);
+    }
+  }
+
+  bool TwoOpt(Route &route) const {
+    const size_t last = route.size() - 2;
+    for (size_t i = 1; i < last; ++i) {
+      for (size_t j = i + 1; j <= last; ++j) {
+        double delta = Distance(route[i - 1], route[j]) +
+                       Distance(route[i], route[j + 1]) -
+                       Distance(route[i - 1], route[i]) -
+                       Distance(route[j], route[j + 1]);
+        if (delta < -EPS) {
+          std::reverse(route.begin() + i, route.begin() + j + 1);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  bool OrOpt(Route &route) const {
+    const size_t last = route.size() - 2;
+    for (size_t length = 1; length <= 3; ++length) {
+      for (size_t i = 1; i + length - 1 <= last; ++i) {
+        size_t j = i + length - 1;
+        int first = route[i], tail = route[j];
+        double removeGain = Distance(route[i - 1], first) +
+                            Distance(tail, route[j + 1]) -
+                            Distance(route[i - 1], route[j + 1]);
+        // Insert between route[p] and route[p + 1] outside [i - 1, j]
+        for (size_t p = 0; p + 1 < route.size(); ++p) {
+          if (p + 1 >= i && p <= j) {
+            continue;
+          }
+          int a = route[p], b = route[p + 1];
+          double forward = Distance(a, first) + Distance(tail, b);
+          double backward = Distance(a, tail) + Distance(first, b);
+          double insertCost = std::min(forward, backward);
+          if (insertCost - Distance(a, b) - removeGain < -EPS) {
+            Route segment(route.begin() + i, route.begin() + j + 1);
+            if (backward < forward) {
+              std::reverse(segment.begin(), segment.end());
+            }
+            route.erase(route.begin() + i, route.begin() + j + 1);
+            size_t at = (p < i ? p + 1 : p + 1 - length);
+            route.insert(route.begin() + at, segment.begin(), segment.end());
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+};
+
+// Roulette-wheel selection of operators whose weights follow their recent
+// scores: after every segment of iterations a weight moves towards the
+// average score of the operator in that segment.
+class AdaptiveWeights {
+public:
+  explicit AdaptiveWeights(size_t count, double reaction = 0.1)
+      : _weights(count, 1.0), _scores(count, 0.0), _uses(count, 0),
+        _reaction(reaction) {}
+
+  template <class RandomEngine> size_t Pick(RandomEngine &re) const {
+    return std::discrete_distribution<size_t>(_weights.begin(),
+                                              _weights.end())(re);
+  }
+
+  void Reward(size_t op, double score) {
+    _scores[op] += score;
+    _uses[op]++;
+  }
+
+  void Adapt() {
+    for (size_t op = 0; op < _weights.size(); ++op) {
+      if (_uses[op]) {
+        _weights[op] = (1 - _reaction) * _weights[op] +
+                       _reaction * _scores[op] / _uses[op];
+        _weights[op] = std::max(_weights[op], 0.01);
+      }
+      _scores[op] = 0;
+      _uses[op] = 0;
+    }
+  }
+
+private:
+  std::vector<double> _weights;
+  std::vector<double> _scores;
+  std::vector<size_t> _uses;
+  double _reaction;
+};
+
 class Solver {
 public:
+  Solver() : routeOptimizer(distances) {}
+
   void ParseFrom(std::istream &in) {
     int numberOfWarehouses;
     in >> numberOfWarehouses >> numberOfVehicles >> capacity;
@@ -43,8 +346,39 @@ public:
     size_t currIndex = 0;
     for (auto &w : warehouses) {
       in >> w.demand >> w.location;
-      w.index = currIndex++;
+      w.inputIndex = w.index = currIndex++;
+    }
+    distances.Build(warehouses);
+  }
+
+  // Renumbers customers along a Hilbert curve so that geographically close
+  // customers get close indices. The depot keeps index 0.
+  void RenumberAlongHilbertCurve() {
+    if (warehouses.size() < 3) {
+      return;
+    }
+    double minX = warehouses[0].location.x, maxX = minX;
+    double minY = warehouses[0].location.y, maxY = minY;
+    for (const auto &w : warehouses) {
+      minX = std::min(minX, w.location.x);
+      maxX = std::max(maxX, w.location.x);
+      minY = std::min(minY, w.location.y);
+      maxY = std::max(maxY, w.location.y);
+    }
+    double side = std::max({maxX - minX, maxY - minY, 1e-9});
+    std::vector<uint64_t> keys(warehouses.size());
+    for (const auto &w : warehouses) {
+      keys[w.index] = ComputeHilbertKey(w.location, minX, minY, side);
     }
+    std::sort(warehouses.begin() + 1, warehouses.end(),
+              [&keys](const Warehouse &w1, const Warehouse &w2) {
+                return keys[w1.index] < keys[w2.index];
+              });
+    for (size_t i = 0; i < warehouses.size(); ++i) {
+      warehouses[i].index = i;
+    }
+    distances.Build(warehouses);
+    routeOptimizer.Clear();
   }
 
   struct Solution {
@@ -53,8 +387,18 @@ public:
     double value = 0.0;
     bool isOptimal = false;
     std::vector<Route> routes;
+    // Demand and length of every route, kept up to date by moves
+    std::vector<int> loads;
+    std::vector<double> lengths;
+    // prefixLoads[r][p] is the demand of routes[r][0..p]
+    std::vector<std::vector<int>> prefixLoads;
+    // Route and position of every customer
+    std::vector<size_t> routeOf;
+    std::vector<size_t> positionOf;
 
-    explicit Solution(int vehicles) { routes.resize(vehicles, Route(1)); }
+    explicit Solution(int vehicles)
+        : routes(vehicles, Route(1)), loads(vehicles, 0),
+          lengths(vehicles, 0), prefixLoads(vehicles) {}
 
     friend std::ostream &operator<<(std::ostream &out,
                                     const Solution &solution) {
@@ -69,8 +413,38 @@ public:
     }
   };
 
-  void DumpSolution(const Solution &solution) const {
-    std::string filename = "./answers/" + std::to_string(warehouses.size());
+  // Replaces the answer if the solution is better. The answer is written to
+  // a temporary file and renamed, so a concurrent reader never sees a partial
+  // answer. By default the answer is ./answers/<number of warehouses>.
+  // Returns whether the answer was replaced.
+  bool DumpSolution(const Solution &solution,
+                    std::string filename = "") const {
+    if (filename.empty()) {
+      filename = "./answers/" + std::to_string(warehouses.size());
+    }
+    // Concurrent runs over the same answer are serialized by a lock file:
+    // the target itself is replaced by rename, so it can't hold the lock
+    std::string lockFilename = filename + ".lock";
+    int lockFd = open(lockFilename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+      if (lockFd >= 0) {
+        close(lockFd);
+      }
+      throw std::runtime_error("Failed to lock " + lockFilename);
+    }
+    try {
+      bool accepted = ReplaceIfBetter(solution, filename);
+      close(lockFd);
+      return accepted;
+    } catch (...) {
+      close(lockFd);
+      throw;
+    }
+  }
+
+  // Must be called with the answer locked
+  bool ReplaceIfBetter(const Solution &solution,
+                       const std::string &filename) const {
     std::ifstream fin(filename);
     bool acceptChange = true;
     if (fin) {
@@ -79,146 +453,703 @@ public:
       acceptChange = (!fin || oldValue > solution.value);
       fin.close();
     }
-    if (acceptChange) {
-      std::ofstream fout(filename, std::ios::out | std::ios::trunc);
-      fout << solution;
+    if (!acceptChange) {
+      return false;
+    }
+    std::string tmpFilename = filename + ".XXXXXX";
+    int tmpFd = mkstemp(tmpFilename.data());
+    if (tmpFd < 0) {
+      throw std::runtime_error("Failed to create " + tmpFilename);
+    }
+    close(tmpFd);
+    {
+      std::ofstream fout(tmpFilename, std::ios::out | std::ios::trunc);
+      fout << RestoreInputOrder(solution);
+      if (!fout) {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error("Failed to write " + tmpFilename);
+      }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+      std::remove(tmpFilename.c_str());
+      throw std::runtime_error("Failed to replace " + filename);
+    }
+    return true;
+  }
+
+  Solution RestoreInputOrder(const Solution &solution) const {
+    auto restored = solution;
+    for (auto &r : restored.routes) {
+      for (auto &w : r) {
+        w = warehouses[w].inputIndex;
+      }
     }
+    return restored;
   }
 
-  double UpdateRouteViaTSP(Solution::Route &route) {
-    // Run TSP solver to improve route
-    std::vector<Vector> pts(route.size() - 1);
-    for (size_t i = 0; i + 1 < route.size(); ++i) {
-      pts[i] = Vector(warehouses[route[i]].location.x,
-                      warehouses[route[i]].location.y);
+  Solution FindSolution(double maxTimeInSeconds, unsigned seed) {
+    auto solution = InitialSolution();
+
+    // Random stuff
+    std::mt19937 mt(seed);
+    std::uniform_int_distribution<size_t> rdCustomer(1,
+                                                     warehouses.size() - 1);
+
+    // Worsening moves are accepted by simulated annealing, temperatures are
+    // relative to an average edge of the initial solution
+    double averageEdge =
+        solution.value / (warehouses.size() + numberOfVehicles);
+    AnnealingSchedule::Params params;
+    params.initTemp = 0.5 * averageEdge;
+    params.finalTemp = 1e-3 * averageEdge;
+    AnnealingSchedule schedule(params);
+    auto best = solution;
+
+    size_t nIters = 20'000'000;
+    SearchBudget budget(maxTimeInSeconds, nIters);
+    std::vector<Move> moves;
+    while (warehouses.size() > 2 && budget.Tick()) {
+      schedule.Update(budget.GetProgress());
+      // A random customer and one of its nearest customers
+      int u = rdCustomer(mt);
+      const auto &nearest = nearestCustomers[u];
+      int v = nearest[std::uniform_int_distribution<size_t>(
+          0, nearest.size() - 1)(mt)];
+      GenerateMoves(solution, u, v, moves);
+      if (moves.empty()) {
+        continue;
+      }
+      const auto &move = moves[std::uniform_int_distribution<size_t>(
+          0, moves.size() - 1)(mt)];
+      if (!IsFeasible(solution, move)) {
+        continue;
+      }
+      double delta = Evaluate(solution, move);
+      if (schedule.Accept(delta, mt)) {
+        Apply(solution, move, delta);
+        UpdateBest(solution, best, schedule);
+      }
     }
-    auto tspSolution = LocalSearchSolver(pts).FindSolution(5);
-    auto depoIt =
-        std::find(tspSolution.indices.begin(), tspSolution.indices.end(), 0);
+    std::cerr << "\nEvaluated moves: " << budget.GetIterations() << '\n';
+    Descend(best);
+    OptimizeRoutes(best);
+    return best;
+  }
 
-    // Update route
-    auto rCpy = route;
-    route.clear();
-    for (auto it = depoIt; it != tspSolution.indices.end(); ++it) {
-      route.push_back(rCpy[*it]);
+  // Adaptive large neighbourhood search: a part of the solution is ruined
+  // and recreated by operators picked with adaptive weights, candidates are
+  // accepted by simulated annealing. Every thread runs an independent
+  // instance with its own seed; the best result is returned.
+  Solution FindSolutionALNS(double maxTimeInSeconds, size_t threadsCount,
+                            unsigned seed) {
+    auto start = InitialSolution();
+    threadsCount = std::max<size_t>(1, threadsCount);
+    std::vector<Solution> results(threadsCount, start);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadsCount; ++t) {
+      threads.emplace_back([&, t] {
+        results[t] = RunALNS(start, maxTimeInSeconds, seed + t);
+      });
     }
-    for (auto it = tspSolution.indices.begin(); it != depoIt; ++it) {
-      route.push_back(rCpy[*it]);
+    for (auto &t : threads) {
+      t.join();
     }
-    route.push_back(0);
-    return tspSolution.distance;
+    auto best = *std::min_element(
+        results.begin(), results.end(),
+        [](const Solution &s1, const Solution &s2) {
+          return s1.value < s2.value;
+        });
+    OptimizeRoutes(best);
+    return best;
   }
 
-  Solution FindSolution() {
-    auto solution = GreedySolution();
+private:
+  int numberOfVehicles;
+  int capacity;
+  std::vector<Warehouse> warehouses;
+  DistanceMatrix distances;
+  RouteOptimizer routeOptimizer;
 
-    std::cerr << "Initial value: " << solution.value << '\n';
+  // Size of the granular neighbourhood: moves only create edges between a
+  // customer and one of its nearest customers
+  const size_t NEAREST_COUNT = 10;
+  const double EPS = 1e-9;
+  std::vector<std::vector<int>> nearestCustomers;
 
-    // Local Search
-    size_t counter = 0;
-    for (auto &r : solution.routes) {
-      counter++;
-      std::cerr << std::setprecision(2) << std::fixed
-                << (counter * 100.0 / numberOfVehicles) << "%\r";
-      if (r.size() <= 2) {
-        continue;
+  // A move between two routes or inside one route. Moves are evaluated by
+  // the change of the affected edges in O(1) and applied only if accepted.
+  struct Move {
+    enum class Type {
+      // Customer route1[pos1] is inserted before route2[pos2]
+      Relocate,
+      // Customers route1[pos1] and route2[pos2] trade places
+      Exchange,
+      // Customers route1[pos1..pos2] are reversed, route1 == route2
+      TwoOpt,
+      // 2-opt*: routes are cut after pos1 and pos2 and trade their tails
+      TwoOptStar,
+      // CROSS-exchange: segments of length1 and length2 customers which
+      // follow pos1 and pos2 trade places
+      Cross
+    };
+
+    Type type = Type::Relocate;
+    size_t route1 = 0, pos1 = 0;
+    size_t route2 = 0, pos2 = 0;
+    size_t length1 = 0, length2 = 0;
+  };
+
+  std::vector<std::vector<int>> ComputeNearestCustomers(size_t k) const {
+    std::vector<std::vector<int>> nearest(warehouses.size());
+    std::vector<int> customers;
+    for (size_t c = 1; c < warehouses.size(); ++c) {
+      customers.clear();
+      for (size_t other = 1; other < warehouses.size(); ++other) {
+        if (other != c) {
+          customers.push_back(other);
+        }
       }
-      // Compute old tour distance
-      double oldDistance = ComputeTourDistance(r);
+      size_t count = std::min(k, customers.size());
+      std::partial_sort(customers.begin(), customers.begin() + count,
+                        customers.end(), [&](int w1, int w2) {
+                          return Distance(c, w1) < Distance(c, w2);
+                        });
+      nearest[c].assign(customers.begin(), customers.begin() + count);
+    }
+    return nearest;
+  }
 
-      // Update value
-      solution.value -= oldDistance - UpdateRouteViaTSP(r);
+  // Moves which make customer v follow customer u. Inside one route it is
+  // a 2-opt move, between routes relocate, exchange, 2-opt* and CROSS.
+  void GenerateMoves(const Solution &solution, int u, int v,
+                     std::vector<Move> &moves) const {
+    moves.clear();
+    size_t ru = solution.routeOf[u], pu = solution.positionOf[u];
+    size_t rv = solution.routeOf[v], pv = solution.positionOf[v];
+    Move move;
+    if (ru == rv) {
+      move.type = Move::Type::TwoOpt;
+      move.route1 = move.route2 = ru;
+      move.pos1 = std::min(pu, pv) + 1;
+      move.pos2 = std::max(pu, pv);
+      if (move.pos1 < move.pos2) {
+        moves.push_back(move);
+      }
+      return;
+    }
+    const auto &r1 = solution.routes[ru];
+    const auto &r2 = solution.routes[rv];
+    // v is inserted right after u
+    move.type = Move::Type::Relocate;
+    move.route1 = rv;
+    move.pos1 = pv;
+    move.route2 = ru;
+    move.pos2 = pu + 1;
+    moves.push_back(move);
+    // v takes the place of u's successor
+    if (r1[pu + 1] != 0) {
+      move.type = Move::Type::Exchange;
+      moves.push_back(move);
+    }
+    // The head of u's route continues with v and the rest of its route
+    move.type = Move::Type::TwoOptStar;
+    move.route1 = ru;
+    move.pos1 = pu;
+    move.route2 = rv;
+    move.pos2 = pv - 1;
+    moves.push_back(move);
+    // Segments after u and starting from v trade places
+    move.type = Move::Type::Cross;
+    for (size_t length1 = 1; length1 <= 3; ++length1) {
+      for (size_t length2 = 1; length2 <= 3; ++length2) {
+        if (pu + length1 + 1 < r1.size() && pv + length2 < r2.size()) {
+          move.length1 = length1;
+          move.length2 = length2;
+          moves.push_back(move);
+        }
+      }
     }
-    std::cerr << '\n';
+  }
 
-    // Random stuff
-    std::random_device rd;
-    std::mt19937 mt(rd());
-    std::uniform_int_distribution<size_t> rdVehicle(0, numberOfVehicles - 1);
-    std::uniform_int_distribution<> actionType(0, 1);
-
-    size_t nIters = 100'000;
-    for (size_t it = 0; it < nIters; ++it) {
-      size_t sourceVehicle = rdVehicle(mt);
-      if (solution.routes[sourceVehicle].size() < 3) {
-        continue;
+  double Distance(int w1, int w2) const { return distances(w1, w2); }
+
+  int Demand(const Solution &solution, size_t route, size_t pos) const {
+    return warehouses[solution.routes[route][pos]].demand;
+  }
+
+  bool IsFeasible(const Solution &solution, const Move &move) const {
+    const auto &prefix1 = solution.prefixLoads[move.route1];
+    const auto &prefix2 = solution.prefixLoads[move.route2];
+    int load1 = solution.loads[move.route1];
+    int load2 = solution.loads[move.route2];
+    switch (move.type) {
+    case Move::Type::Relocate:
+      return load2 + Demand(solution, move.route1, move.pos1) <= capacity;
+    case Move::Type::Exchange: {
+      int demand1 = Demand(solution, move.route1, move.pos1);
+      int demand2 = Demand(solution, move.route2, move.pos2);
+      return load1 - demand1 + demand2 <= capacity &&
+             load2 - demand2 + demand1 <= capacity;
+    }
+    case Move::Type::TwoOpt:
+      return true;
+    case Move::Type::TwoOptStar: {
+      int head1 = prefix1[move.pos1], head2 = prefix2[move.pos2];
+      return head1 + load2 - head2 <= capacity &&
+             head2 + load1 - head1 <= capacity;
+    }
+    case Move::Type::Cross: {
+      int segment1 = prefix1[move.pos1 + move.length1] - prefix1[move.pos1];
+      int segment2 = prefix2[move.pos2 + move.length2] - prefix2[move.pos2];
+      return load1 - segment1 + segment2 <= capacity &&
+             load2 - segment2 + segment1 <= capacity;
+    }
+    }
+    return false;
+  }
+
+  // Change of the solution value after the move
+  double Evaluate(const Solution &solution, const Move &move) const {
+    const auto &r1 = solution.routes[move.route1];
+    const auto &r2 = solution.routes[move.route2];
+    size_t i = move.pos1, j = move.pos2;
+    switch (move.type) {
+    case Move::Type::Relocate:
+      return Distance(r1[i - 1], r1[i + 1]) - Distance(r1[i - 1], r1[i]) -
+             Distance(r1[i], r1[i + 1]) + Distance(r2[j - 1], r1[i]) +
+             Distance(r1[i], r2[j]) - Distance(r2[j - 1], r2[j]);
+    case Move::Type::Exchange:
+      return Distance(r1[i - 1], r2[j]) + Distance(r2[j], r1[i + 1]) -
+             Distance(r1[i - 1], r1[i]) - Distance(r1[i], r1[i + 1]) +
+             Distance(r2[j - 1], r1[i]) + Distance(r1[i], r2[j + 1]) -
+             Distance(r2[j - 1], r2[j]) - Distance(r2[j], r2[j + 1]);
+    case Move::Type::TwoOpt:
+      return Distance(r1[i - 1], r1[j]) + Distance(r1[i], r1[j + 1]) -
+             Distance(r1[i - 1], r1[i]) - Distance(r1[j], r1[j + 1]);
+    case Move::Type::TwoOptStar:
+      return Distance(r1[i], r2[j + 1]) + Distance(r2[j], r1[i + 1]) -
+             Distance(r1[i], r1[i + 1]) - Distance(r2[j], r2[j + 1]);
+    case Move::Type::Cross: {
+      int last1 = r1[i + move.length1], next1 = r1[i + move.length1 + 1];
+      int last2 = r2[j + move.length2], next2 = r2[j + move.length2 + 1];
+      return Distance(r1[i], r2[j + 1]) + Distance(last2, next1) +
+             Distance(r2[j], r1[i + 1]) + Distance(last1, next2) -
+             Distance(r1[i], r1[i + 1]) - Distance(last1, next1) -
+             Distance(r2[j], r2[j + 1]) - Distance(last2, next2);
+    }
+    }
+    return 0;
+  }
+
+  void Apply(Solution &solution, const Move &move, double delta) const {
+    auto &r1 = solution.routes[move.route1];
+    auto &r2 = solution.routes[move.route2];
+    size_t i = move.pos1, j = move.pos2;
+    switch (move.type) {
+    case Move::Type::Relocate: {
+      int customer = r1[i];
+      r1.erase(r1.begin() + i);
+      r2.insert(r2.begin() + j, customer);
+      break;
+    }
+    case Move::Type::Exchange:
+      std::swap(r1[i], r2[j]);
+      break;
+    case Move::Type::TwoOpt:
+      std::reverse(r1.begin() + i, r1.begin() + j + 1);
+      break;
+    case Move::Type::TwoOptStar: {
+      Solution::Route tail1(r1.begin() + i + 1, r1.end());
+      r1.resize(i + 1);
+      r1.insert(r1.end(), r2.begin() + j + 1, r2.end());
+      r2.resize(j + 1);
+      r2.insert(r2.end(), tail1.begin(), tail1.end());
+      break;
+    }
+    case Move::Type::Cross: {
+      Solution::Route segment1(r1.begin() + i + 1,
+                               r1.begin() + i + 1 + move.length1);
+      Solution::Route segment2(r2.begin() + j + 1,
+                               r2.begin() + j + 1 + move.length2);
+      r1.erase(r1.begin() + i + 1, r1.begin() + i + 1 + move.length1);
+      r1.insert(r1.begin() + i + 1, segment2.begin(), segment2.end());
+      r2.erase(r2.begin() + j + 1, r2.begin() + j + 1 + move.length2);
+      r2.insert(r2.begin() + j + 1, segment1.begin(), segment1.end());
+      break;
+    }
+    }
+    UpdateRouteStats(solution, move.route1);
+    if (move.route2 != move.route1) {
+      UpdateRouteStats(solution, move.route2);
+    }
+    solution.value += delta;
+  }
+
+  // First-improvement descent over the granular neighbourhood: every
+  // customer is tried with its nearest customers until no move improves
+  void Descend(Solution &solution) const {
+    if (warehouses.size() < 3) {
+      return;
+    }
+    std::vector<Move> moves;
+    bool improved = true;
+    while (improved) {
+      improved = false;
+      for (size_t u = 1; u < warehouses.size(); ++u) {
+        for (int v : nearestCustomers[u]) {
+          GenerateMoves(solution, u, v, moves);
+          for (const auto &move : moves) {
+            if (!IsFeasible(solution, move)) {
+              continue;
+            }
+            double delta = Evaluate(solution, move);
+            if (delta < -EPS) {
+              Apply(solution, move, delta);
+              improved = true;
+              break;
+            }
+          }
+        }
       }
-      size_t destinationVehicle = rdVehicle(mt);
-      if (actionType(mt)) { // trying make transfer
-        std::uniform_int_distribution<size_t> rdCustomer(
-            1, solution.routes[sourceVehicle].size() - 2);
-        size_t targetInd = rdCustomer(mt);
-        int whouse = solution.routes[sourceVehicle][targetInd];
-        int currentDemand = 0;
-        for (auto w : solution.routes[destinationVehicle]) {
-          currentDemand += warehouses[w].demand;
+    }
+  }
+
+  // Recomputes cached stats of one route from its customers
+  void UpdateRouteStats(Solution &solution, size_t r) const {
+    const auto &route = solution.routes[r];
+    auto &prefix = solution.prefixLoads[r];
+    prefix.resize(route.size());
+    int load = 0;
+    for (size_t p = 0; p < route.size(); ++p) {
+      load += warehouses[route[p]].demand;
+      prefix[p] = load;
+      if (route[p]) {
+        solution.routeOf[route[p]] = r;
+        solution.positionOf[route[p]] = p;
+      }
+    }
+    solution.loads[r] = load;
+    solution.lengths[r] = ComputeTourDistance(route);
+  }
+
+  // Reorders customers inside every route by the route optimizer
+  void OptimizeRoutes(Solution &solution) {
+    for (auto &r : solution.routes) {
+      routeOptimizer.Optimize(r);
+    }
+    RefreshRouteStats(solution);
+  }
+
+  // Recomputes cached loads, lengths and the value from the routes
+  void RefreshRouteStats(Solution &solution) const {
+    solution.routeOf.resize(warehouses.size());
+    solution.positionOf.resize(warehouses.size());
+    solution.value = 0;
+    for (size_t r = 0; r < solution.routes.size(); ++r) {
+      UpdateRouteStats(solution, r);
+      solution.value += solution.lengths[r];
+    }
+  }
+
+  // Savings routes (sweep or greedy ones if savings do not fit into the
+  // vehicles) improved by the route optimizer and the granular descent
+  Solution InitialSolution() {
+    nearestCustomers = ComputeNearestCustomers(NEAREST_COUNT);
+    auto initial = SavingsSolution();
+    if (!initial) {
+      initial = SweepSolution();
+    }
+    auto solution = (initial ? *initial : GreedySolution());
+
+    std::cerr << "Initial value: " << solution.value << '\n';
+    OptimizeRoutes(solution);
+    Descend(solution);
+    std::cerr << "Descent value: " << solution.value << '\n';
+    return solution;
+  }
+
+  enum class Ruin { Random, Worst, Shaw, Route };
+  // Greedy insertion is regret-1
+  const size_t MAX_REGRET = 3;
+
+  Solution RunALNS(const Solution &start, double maxTimeInSeconds,
+                   unsigned seed) const {
+    std::mt19937 mt(seed);
+    Solution current = start, best = start;
+    AdaptiveWeights ruinWeights(4), recreateWeights(MAX_REGRET);
+    // A solution 5% worse than the initial one is accepted with
+    // probability 1/2 at the beginning
+    AnnealingSchedule::Params params;
+    params.initTemp = 0.05 * start.value / std::log(2.0);
+    params.finalTemp = 1e-3 * params.initTemp;
+    AnnealingSchedule schedule(params);
+
+    const size_t customersCount = warehouses.size() - 1;
+    const size_t minRemoved = std::min<size_t>(4, customersCount);
+    const size_t maxRemoved =
+        std::max(minRemoved, std::min<size_t>(60, customersCount * 3 / 10));
+    // Scores of an operator pair whose candidate became the new best, was
+    // better than the current solution, or was accepted while worse
+    const double NEW_BEST = 33, IMPROVED = 9, ACCEPTED = 13;
+    const size_t SEGMENT = 100;
+
+    SearchBudget budget(maxTimeInSeconds, std::numeric_limits<size_t>::max(),
+                        1);
+    while (customersCount > 1 && budget.Tick()) {
+      schedule.Update(budget.GetProgress());
+      size_t ruin = ruinWeights.Pick(mt);
+      size_t regret = recreateWeights.Pick(mt) + 1;
+      size_t count =
+          std::uniform_int_distribution<size_t>(minRemoved, maxRemoved)(mt);
+      Solution candidate = current;
+      auto removed = RuinSolution(candidate, (Ruin)ruin, count, mt);
+      double score = 0;
+      if (RecreateSolution(candidate, removed, regret)) {
+        Descend(candidate);
+        double delta = candidate.value - current.value;
+        if (candidate.value < best.value - EPS) {
+          score = NEW_BEST;
+        } else if (delta < -EPS) {
+          score = IMPROVED;
         }
-        if (warehouses[whouse].demand + currentDemand <= capacity) {
-          auto copySolution = solution;
-          copySolution.routes[sourceVehicle].erase(
-              copySolution.routes[sourceVehicle].begin() + targetInd);
-          copySolution.routes[destinationVehicle].pop_back();
-          copySolution.routes[destinationVehicle].push_back(whouse);
-          copySolution.routes[destinationVehicle].push_back(0);
-          double oldDistance =
-              ComputeTourDistance(solution.routes[destinationVehicle]) +
-              ComputeTourDistance(solution.routes[sourceVehicle]);
-          double newDistance =
-              UpdateRouteViaTSP(copySolution.routes[destinationVehicle]) +
-              ComputeTourDistance(copySolution.routes[sourceVehicle]);
-          if (newDistance < oldDistance) {
-            copySolution.value = solution.value - oldDistance + newDistance;
-            solution = copySolution;
-            std::cerr << "New value found: " << solution.value << '\r';
+        if (schedule.Accept(delta, mt)) {
+          if (!score && delta > EPS) {
+            score = ACCEPTED;
+          }
+          current = std::move(candidate);
+          if (score == NEW_BEST) {
+            best = current;
+            schedule.NotifyImprovement();
           }
         }
-      } else if (solution.routes[destinationVehicle].size() > 2) { // swap
-        std::uniform_int_distribution<size_t> rdCustomerFromSource(
-            1, solution.routes[sourceVehicle].size() - 2);
-        std::uniform_int_distribution<size_t> rdCustomerFromDest(
-            1, solution.routes[destinationVehicle].size() - 2);
-        auto w1 = rdCustomerFromSource(mt);
-        auto w2 = rdCustomerFromDest(mt);
-        int currentDemand1 = 0, currentDemand2 = 0;
-        for (auto w : solution.routes[sourceVehicle]) {
-          currentDemand1 += warehouses[w].demand;
+      }
+      ruinWeights.Reward(ruin, score);
+      recreateWeights.Reward(regret - 1, score);
+      if (budget.GetIterations() % SEGMENT == 0) {
+        ruinWeights.Adapt();
+        recreateWeights.Adapt();
+      }
+    }
+    RefreshRouteStats(best);
+    return best;
+  }
+
+  // Removes `count` customers chosen by the ruin operator, returns them
+  std::vector<int> RuinSolution(Solution &solution, Ruin ruin, size_t count,
+                                std::mt19937 &mt) const {
+    const size_t n = warehouses.size();
+    std::vector<int> removed;
+    std::vector<bool> isRemoved(n, false);
+    std::uniform_real_distribution<double> unif(0, 1);
+    // Index into a list sorted by preference, biased towards its head
+    auto biasedIndex = [&](size_t size, double power) {
+      return std::min<size_t>(size - 1, std::pow(unif(mt), power) * size);
+    };
+    auto remove = [&](int customer) {
+      RemoveCustomer(solution, customer);
+      isRemoved[customer] = true;
+      removed.push_back(customer);
+    };
+    std::vector<int> candidates;
+    auto collectCandidates = [&]() {
+      candidates.clear();
+      for (size_t c = 1; c < n; ++c) {
+        if (!isRemoved[c]) {
+          candidates.push_back(c);
         }
-        for (auto w : solution.routes[destinationVehicle]) {
-          currentDemand2 += warehouses[w].demand;
+      }
+    };
+
+    switch (ruin) {
+    case Ruin::Random:
+      collectCandidates();
+      std::shuffle(candidates.begin(), candidates.end(), mt);
+      for (size_t i = 0; i < count; ++i) {
+        remove(candidates[i]);
+      }
+      break;
+    case Ruin::Worst:
+      // Customers whose removal shortens the routes most
+      while (removed.size() < count) {
+        collectCandidates();
+        std::vector<std::pair<double, int>> gains;
+        for (int c : candidates) {
+          const auto &route = solution.routes[solution.routeOf[c]];
+          size_t p = solution.positionOf[c];
+          gains.push_back({Distance(route[p - 1], c) +
+                               Distance(c, route[p + 1]) -
+                               Distance(route[p - 1], route[p + 1]),
+                           c});
         }
-        if (currentDemand1 + warehouses[w2].demand > capacity &&
-            currentDemand2 + warehouses[w1].demand > capacity) {
-          continue;
+        std::sort(gains.rbegin(), gains.rend());
+        remove(gains[biasedIndex(gains.size(), 3)].second);
+      }
+      break;
+    case Ruin::Shaw: {
+      // Customers related to already removed ones by distance and demand
+      double maxDistance = EPS;
+      int maxDemand = 1;
+      for (size_t c = 1; c < n; ++c) {
+        maxDistance = std::max<double>(maxDistance, distances.FromDepot(c));
+        maxDemand = std::max(maxDemand, warehouses[c].demand);
+      }
+      collectCandidates();
+      remove(candidates[std::uniform_int_distribution<size_t>(
+          0, candidates.size() - 1)(mt)]);
+      while (removed.size() < count) {
+        int seed = removed[std::uniform_int_distribution<size_t>(
+            0, removed.size() - 1)(mt)];
+        collectCandidates();
+        auto relatedness = [&](int c) {
+          return Distance(seed, c) / maxDistance +
+                 std::abs(warehouses[seed].demand - warehouses[c].demand) /
+                     (double)maxDemand;
+        };
+        std::sort(candidates.begin(), candidates.end(), [&](int c1, int c2) {
+          return relatedness(c1) < relatedness(c2);
+        });
+        remove(candidates[biasedIndex(candidates.size(), 6)]);
+      }
+      break;
+    }
+    case Ruin::Route:
+      // Whole random routes
+      while (removed.size() < count) {
+        size_t r = std::uniform_int_distribution<size_t>(
+            0, solution.routes.size() - 1)(mt);
+        while (solution.routes[r].size() > 2) {
+          remove(solution.routes[r][1]);
         }
-        auto copySolution = solution;
-        std::swap(copySolution.routes[sourceVehicle][w1],
-                  copySolution.routes[destinationVehicle][w2]);
-        double oldDistance =
-            ComputeTourDistance(solution.routes[destinationVehicle]) +
-            ComputeTourDistance(solution.routes[sourceVehicle]);
-        double newDistance =
-            UpdateRouteViaTSP(copySolution.routes[destinationVehicle]) +
-            UpdateRouteViaTSP(copySolution.routes[sourceVehicle]);
-        if (newDistance < oldDistance) {
-          copySolution.value = solution.value - oldDistance + newDistance;
-          solution = copySolution;
-          std::cerr << "New value found: " << solution.value << '\r';
+        if (removed.empty()) {
+          collectCandidates();
+          remove(candidates[std::uniform_int_distribution<size_t>(
+              0, candidates.size() - 1)(mt)]);
         }
       }
+      break;
     }
-    return solution;
+    return removed;
   }
 
-private:
-  int numberOfVehicles;
-  int capacity;
-  std::vector<Warehouse> warehouses;
+  // Inserts the customers back one by one. Regret-1 inserts the customer
+  // with the cheapest insertion first; regret-k the one which loses most if
+  // not inserted into its best route, by the sum of differences to its k-1
+  // next best routes. Best insertions into every route are cached and only
+  // recomputed for the route which has changed.
+  // Returns false if some customer does not fit into any route.
+  bool RecreateSolution(Solution &solution, std::vector<int> pending,
+                        size_t regret) const {
+    const double INF = std::numeric_limits<double>::infinity();
+    const size_t routesCount = solution.routes.size();
+    // cost[i * routesCount + r] and position of the best insertion of
+    // pending[i] into route r
+    std::vector<double> cost(pending.size() * routesCount);
+    std::vector<size_t> position(pending.size() * routesCount);
+    auto updateCache = [&](size_t i, size_t r) {
+      int c = pending[i];
+      const auto &route = solution.routes[r];
+      double best = INF;
+      size_t bestPosition = 0;
+      if (solution.loads[r] + warehouses[c].demand <= capacity) {
+        for (size_t p = 1; p < route.size(); ++p) {
+          double insertion = Distance(route[p - 1], c) +
+                             Distance(c, route[p]) -
+                             Distance(route[p - 1], route[p]);
+          if (insertion < best) {
+            best = insertion;
+            bestPosition = p;
+          }
+        }
+      }
+      cost[i * routesCount + r] = best;
+      position[i * routesCount + r] = bestPosition;
+    };
+    for (size_t i = 0; i < pending.size(); ++i) {
+      for (size_t r = 0; r < routesCount; ++r) {
+        updateCache(i, r);
+      }
+    }
+
+    std::vector<double> costs(routesCount);
+    while (!pending.empty()) {
+      size_t chosen = 0, chosenRoute = 0;
+      double chosenScore = -INF, chosenCost = INF;
+      for (size_t i = 0; i < pending.size(); ++i) {
+        const double *row = &cost[i * routesCount];
+        size_t bestRoute =
+            std::min_element(row, row + routesCount) - row;
+        if (row[bestRoute] == INF) {
+          return false;
+        }
+        double score = -row[bestRoute];
+        if (regret > 1) {
+          costs.assign(row, row + routesCount);
+          size_t k = std::min(regret, routesCount);
+          std::partial_sort(costs.begin(), costs.begin() + k, costs.end());
+          score = 0;
+          for (size_t h = 1; h < k; ++h) {
+            // Customers with few feasible routes come first
+            score += std::min(costs[h], 1e9) - costs[0];
+          }
+        }
+        if (score > chosenScore ||
+            (score == chosenScore && row[bestRoute] < chosenCost)) {
+          chosen = i;
+          chosenRoute = bestRoute;
+          chosenScore = score;
+          chosenCost = row[bestRoute];
+        }
+      }
+      InsertCustomer(solution, pending[chosen], chosenRoute,
+                     position[chosen * routesCount + chosenRoute]);
+      // Drop the inserted customer from the cache
+      size_t last = pending.size() - 1;
+      pending[chosen] = pending[last];
+      std::copy(cost.begin() + last * routesCount,
+                cost.begin() + (last + 1) * routesCount,
+                cost.begin() + chosen * routesCount);
+      std::copy(position.begin() + last * routesCount,
+                position.begin() + (last + 1) * routesCount,
+                position.begin() + chosen * routesCount);
+      pending.pop_back();
+      for (size_t i = 0; i < pending.size(); ++i) {
+        updateCache(i, chosenRoute);
+      }
+    }
+    return true;
+  }
+
+  void RemoveCustomer(Solution &solution, int customer) const {
+    size_t r = solution.routeOf[customer];
+    auto &route = solution.routes[r];
+    route.erase(route.begin() + solution.positionOf[customer]);
+    solution.value -= solution.lengths[r];
+    UpdateRouteStats(solution, r);
+    solution.value += solution.lengths[r];
+  }
+
+  void InsertCustomer(Solution &solution, int customer, size_t r,
+                      size_t position) const {
+    auto &route = solution.routes[r];
+    route.insert(route.begin() + position, customer);
+    solution.value -= solution.lengths[r];
+    UpdateRouteStats(solution, r);
+    solution.value += solution.lengths[r];
+  }
+
+  static void UpdateBest(const Solution &solution, Solution &best,
+                         AnnealingSchedule &schedule) {
+    if (solution.value < best.value) {
+      best = solution;
+      schedule.NotifyImprovement();
+      std::cerr << "New value found: " << best.value << '\r';
+    }
+  }
 
   double ComputeTourDistance(const Solution::Route &route) const {
     double distance = 0;
     for (size_t i = 1; i < route.size(); ++i) {
-      distance += length(warehouses[route[i - 1]].location,
-                         warehouses[route[i]].location);
+      distance += distances(route[i - 1], route[i]);
     }
     return distance;
   }
@@ -245,23 +1176,247 @@ private:
     }
     for (auto &r : solution.routes) {
       r.push_back(0);
-      solution.value += ComputeTourDistance(r);
+    }
+    RefreshRouteStats(solution);
+    return solution;
+  }
+
+  // Sweep construction: customers are sorted by polar angle around the
+  // depot, starting after the widest angular gap, and cut into consecutive
+  // routes which fill the vehicles. Returns nothing if the vehicles are not
+  // enough.
+  std::optional<Solution> SweepSolution() const {
+    const size_t n = warehouses.size();
+    std::vector<int> customers(n - 1);
+    std::iota(customers.begin(), customers.end(), 1);
+    std::sort(customers.begin(), customers.end(), [this](int c1, int c2) {
+      return distances.GetAngle(c1) < distances.GetAngle(c2);
+    });
+    size_t start = 0;
+    double widestGap = -1;
+    for (size_t i = 0; i < customers.size(); ++i) {
+      double gap = distances.GetAngle(customers[i]) -
+                   distances.GetAngle(customers[(i + customers.size() - 1) %
+                                                customers.size()]);
+      if (gap <= 0) {
+        gap += 2 * M_PI;
+      }
+      if (gap > widestGap) {
+        widestGap = gap;
+        start = i;
+      }
+    }
+    std::rotate(customers.begin(), customers.begin() + start, customers.end());
+
+    Solution solution(numberOfVehicles);
+    int vehicle = 0, load = 0;
+    for (int c : customers) {
+      if (load + warehouses[c].demand > capacity) {
+        solution.routes[vehicle].push_back(0);
+        if (++vehicle == numberOfVehicles) {
+          return std::nullopt;
+        }
+        load = 0;
+      }
+      load += warehouses[c].demand;
+      solution.routes[vehicle].push_back(c);
+    }
+    for (int v = vehicle; v < numberOfVehicles; ++v) {
+      solution.routes[v].push_back(0);
+    }
+    RefreshRouteStats(solution);
+    return solution;
+  }
+
+  // Clarke-Wright parallel savings. Every customer starts on its own route
+  // and routes are joined at their ends in the order of decreasing saving
+  // d(0, i) + d(0, j) - d(i, j). Pairs from the nearest lists are merged
+  // first; if more routes than vehicles are left, all pairs are tried.
+  // Returns nothing if the routes still do not fit into the vehicles.
+  std::optional<Solution> SavingsSolution() const {
+    const size_t n = warehouses.size();
+    // Routes are paths over customers: links to path neighbours, routes
+    // are tracked by disjoint sets
+    std::vector<std::array<int, 2>> links(n, {0, 0});
+    std::vector<int> degree(n, 0);
+    std::vector<size_t> parent(n);
+    std::vector<int> loads(n);
+    for (size_t c = 0; c < n; ++c) {
+      parent[c] = c;
+      loads[c] = warehouses[c].demand;
+    }
+    auto find = [&parent](size_t c) {
+      while (parent[c] != c) {
+        c = parent[c] = parent[parent[c]];
+      }
+      return c;
+    };
+    size_t routesCount = n - 1;
+
+    using Saving = std::pair<double, std::pair<int, int>>;
+    auto merge = [&](std::vector<Saving> &savings, bool untilFits) {
+      std::sort(savings.rbegin(), savings.rend());
+      for (const auto &saving : savings) {
+        if (untilFits && routesCount <= (size_t)numberOfVehicles) {
+          break;
+        }
+        int i = saving.second.first, j = saving.second.second;
+        size_t ri = find(i), rj = find(j);
+        if (degree[i] == 2 || degree[j] == 2 || ri == rj ||
+            loads[ri] + loads[rj] > capacity) {
+          continue;
+        }
+        links[i][degree[i]++] = j;
+        links[j][degree[j]++] = i;
+        parent[ri] = rj;
+        loads[rj] += loads[ri];
+        routesCount--;
+      }
+    };
+    auto saving = [this](int i, int j) {
+      return distances.FromDepot(i) + distances.FromDepot(j) - Distance(i, j);
+    };
+
+    std::vector<Saving> savings;
+    for (size_t i = 1; i < n; ++i) {
+      for (int j : nearestCustomers[i]) {
+        if ((int)i < j) {
+          savings.push_back({saving(i, j), {i, j}});
+        }
+      }
+    }
+    merge(savings, false);
+    if (routesCount > (size_t)numberOfVehicles) {
+      savings.clear();
+      for (size_t i = 1; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+          savings.push_back({saving(i, j), {i, j}});
+        }
+      }
+      merge(savings, true);
+    }
+    if (routesCount > (size_t)numberOfVehicles) {
+      return std::nullopt;
     }
 
+    Solution solution(numberOfVehicles);
+    std::vector<bool> visited(n, false);
+    size_t vehicle = 0;
+    for (size_t c = 1; c < n; ++c) {
+      if (visited[c] || degree[c] == 2) {
+        continue;
+      }
+      // c is an end of its path, walk to the other end
+      auto &route = solution.routes[vehicle++];
+      int previous = 0, current = c;
+      while (current) {
+        visited[current] = true;
+        route.push_back(current);
+        int next = 0;
+        for (int d = 0; d < degree[current]; ++d) {
+          if (links[current][d] != previous) {
+            next = links[current][d];
+          }
+        }
+        previous = current;
+        current = next;
+      }
+    }
+    for (auto &r : solution.routes) {
+      r.push_back(0);
+    }
+    RefreshRouteStats(solution);
     return solution;
   }
 };
 
-void solve(std::istream &in) {
+struct Options {
+  bool hilbertOrder = false;
+  // Adaptive large neighbourhood search instead of plain annealing
+  bool alns = false;
+  size_t threadsCount = 1;
+  // Instances solved at the same time, 0 to fill the hardware threads
+  size_t jobsCount = 0;
+  // Time budget of every instance
+  double maxTimeInSeconds = 60;
+  unsigned seed = 1;
+};
+
+struct Instance {
+  std::string filename;
+  // Empty for the default ./answers/<number of warehouses>
+  std::string answerFilename;
+  unsigned seed;
+};
+
+double solve(std::istream &in, const Options &options,
+             const Instance &instance) {
   Solver solver;
   solver.ParseFrom(in);
-  auto solution = solver.FindSolution();
-  solver.DumpSolution(solution);
+  if (options.hilbertOrder) {
+    solver.RenumberAlongHilbertCurve();
+  }
+  auto solution =
+      (options.alns
+           ? solver.FindSolutionALNS(options.maxTimeInSeconds,
+                                     options.threadsCount, instance.seed)
+           : solver.FindSolution(options.maxTimeInSeconds, instance.seed));
+  solver.DumpSolution(solution, instance.answerFilename);
+  return solution.value;
+}
+
+// Solves the instances concurrently on a pool of jobsCount workers
+void solveAll(const std::vector<Instance> &instances, const Options &options) {
+  size_t jobsCount = options.jobsCount;
+  if (jobsCount == 0) {
+    size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    jobsCount = std::max<size_t>(1, hardwareThreads / options.threadsCount);
+  }
+  jobsCount = std::min(jobsCount, instances.size());
+
+  std::vector<std::string> results(instances.size());
+  std::atomic<size_t> next{0};
+  auto work = [&] {
+    for (size_t i = next++; i < instances.size(); i = next++) {
+      const auto &instance = instances[i];
+      auto start = std::chrono::steady_clock::now();
+      std::ifstream fin(instance.filename);
+      std::ostringstream result;
+      try {
+        if (!fin) {
+          throw std::runtime_error("Failed to open " + instance.filename);
+        }
+        double value = solve(fin, options, instance);
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        result << std::fixed << std::setprecision(2) << value << " in "
+               << seconds << "s";
+      } catch (const std::exception &e) {
+        result << "failed: " << e.what();
+      }
+      results[i] = result.str();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t j = 0; j < jobsCount; ++j) {
+    workers.emplace_back(work);
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  for (size_t i = 0; i < instances.size(); ++i) {
+    std::cerr << instances[i].filename << ": " << results[i] << '\n';
+  }
 }
 
 int main(int argc, char *argv[]) {
   if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " test1 test2 ...\n";
+    std::cerr << "Usage: " << argv[0]
+              << " [--hilbert] [--alns] [--threads <count>] [--jobs <count>]"
+                 " [--time <seconds>] [--seed <seed>] [--data <directory>]"
+                 " test1 test2 ...\n"
+                 "Instances of --data are answered to ./answers/<name>\n";
     return EXIT_FAILURE;
   }
 
@@ -269,10 +1424,46 @@ int main(int argc, char *argv[]) {
       "./data/vrp_16_3_1",   "./data/vrp_26_8_1",   "./data/vrp_51_5_1",
       "./data/vrp_101_10_1", "./data/vrp_200_16_1", "./data/vrp_421_41_1"};
 
+  Options options;
+  std::vector<Instance> instances;
   for (int i = 1; i < argc; ++i) {
-    int test = atoi(argv[i]);
-    std::cerr << "Running test " << test << '\n';
-    std::ifstream fin(files[test - 1]);
-    solve(fin);
+    std::string arg = argv[i];
+    if (arg == "--hilbert") {
+      options.hilbertOrder = true;
+    } else if (arg == "--alns") {
+      options.alns = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      options.threadsCount = std::max(1ul, std::stoul(argv[++i]));
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      options.jobsCount = std::stoul(argv[++i]);
+    } else if (arg == "--time" && i + 1 < argc) {
+      options.maxTimeInSeconds = std::stod(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      options.seed = std::stoul(argv[++i]);
+    } else if (arg == "--data" && i + 1 < argc) {
+      std::vector<std::string> names;
+      for (const auto &entry : std::filesystem::directory_iterator(argv[++i])) {
+        if (entry.is_regular_file()) {
+          names.push_back(entry.path().filename().string());
+        }
+      }
+      std::sort(names.begin(), names.end());
+      for (const auto &name : names) {
+        instances.push_back({std::string(argv[i]) + "/" + name,
+                             "./answers/" + name, 0});
+      }
+    } else {
+      int test = atoi(argv[i]);
+      if (test < 1 || test > int(files.size())) {
+        std::cerr << "Unknown test " << arg << '\n';
+        return EXIT_FAILURE;
+      }
+      instances.push_back({files[test - 1], "", 0});
+    }
   }
-}
\ No newline at end of file
+  // Every instance gets its own seed
+  for (size_t i = 0; i < instances.size(); ++i) {
+    instances[i].seed = options.seed + i * options.threadsCount;
+  }
+  solveAll(instances, options);
+}